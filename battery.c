@@ -2,8 +2,13 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <glob.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include "battery.h"
+#include "supply.h"
+#include "uring.h"
+#include "stats.h"
 
 void battery_init(Battery *bt) {
   bt->id = -1;
@@ -11,6 +16,17 @@ void battery_init(Battery *bt) {
   bt->is_charging = false;
   bt->capacity = -1;
   bt->seconds_remaining = -1;
+  bt->energy_now = -1;
+  bt->energy_full = -1;
+  bt->power = -1;
+}
+
+bool battery_equal(const Battery *a, const Battery *b) {
+  return a->id == b->id && a->is_ac_power == b->is_ac_power
+    && a->is_charging == b->is_charging && a->capacity == b->capacity
+    && a->seconds_remaining == b->seconds_remaining
+    && a->energy_now == b->energy_now && a->energy_full == b->energy_full
+    && a->power == b->power;
 }
 
 // search through all the ac adapters & return 1 if at least one of
@@ -19,37 +35,32 @@ void battery_init(Battery *bt) {
 // but I don't have such hardware
 static
 int ac_power() {
-  int result = 0;
-
-  glob_t gbuf;
-  if (glob("/sys/class/power_supply/AC*", 0, NULL, &gbuf) != 0)
-    result = -1; // no ac adapters!
-
-  for (size_t i = 0; i < gbuf.gl_pathc /* 0 if glob returned not 0 */; ++i) {
-    char *indicator = "/online";
-    int path_size = strlen(gbuf.gl_pathv[i]) + strlen(indicator) + 1;
-    char path[path_size];
-    snprintf(path, path_size, "%s%s", gbuf.gl_pathv[i], indicator);
-
-    FILE *fp = fopen(path, "r"); if (!fp) continue;
-    int ch = getc(fp);
-    fclose(fp);
-    if (ch == '1') {
-      result = 1;
-      break;
-    }
+  int result = -1; // no ac adapters!
+
+  const SupplyList *list = supply_list();
+  for (size_t i = 0; i < list->count; ++i) {
+    if (!supply_is_adapter(&list->items[i])) continue;
+    if (result == -1) result = 0;
+
+    char path[FILENAME_MAX];
+    supply_path(&list->items[i], "online", path, sizeof(path));
+    int fd = open(path, O_RDONLY | O_CLOEXEC); if (fd == -1) continue;
+    char ch;
+    ssize_t len = read(fd, &ch, 1);
+    close(fd);
+    if (len == 1 && ch == '1') return 1;
   }
 
-  globfree(&gbuf);
   return result;
 }
 
 bool battery_get(int id, Battery *bt) {
-  char file[BUFSIZ];
-  snprintf(file, BUFSIZ, "/sys/class/power_supply/BAT%d/uevent", id);
-  bool r = battery_get_from_file(file, bt);
-  bt->id = id;
-  return r;
+  static BatterySession session = { .id = -1 };
+  if (session.id != id || !session.count) {
+    battery_session_close(&session);
+    if (!battery_session_open(&session, id)) return false;
+  }
+  return battery_session_get(&session, bt);
 }
 
 static
@@ -66,6 +77,9 @@ typedef struct Uevent {
   long energy_full_design;
   long voltage;
   bool is_mWh;
+  const char *name;		// points into the parsed buffer
+  size_t name_len;
+  int online;
 } Uevent;
 
 void uevent_init(Uevent *ue) {
@@ -77,109 +91,574 @@ void uevent_init(Uevent *ue) {
   ue->energy_full_design = -1;
   ue->voltage = -1;
   ue->is_mWh = true;
+  ue->name = NULL;
+  ue->name_len = 0;
+  ue->online = -1;
 }
 
+// all the keys we care about share this prefix
+#define KEY_PREFIX "POWER_SUPPLY_"
+#define KEY_PREFIX_LEN (sizeof(KEY_PREFIX) - 1)
+
+typedef enum {
+  KEY_UNKNOWN,
+  KEY_STATUS,
+  KEY_CAPACITY,
+  KEY_VOLTAGE_NOW,
+  KEY_POWER_NOW,
+  KEY_CURRENT_NOW,
+  KEY_ENERGY_FULL,
+  KEY_CHARGE_FULL,
+  KEY_ENERGY_FULL_DESIGN,
+  KEY_CHARGE_FULL_DESIGN,
+  KEY_ENERGY_NOW,
+  KEY_CHARGE_NOW,
+  KEY_NAME,
+  KEY_ONLINE,
+} Key;
+
+#define KEY_IS(name) (memcmp(key, name, sizeof(name) - 1) == 0)
+
+// map a key (w/o the prefix) to its id; the length selects a bucket
+// & the 1st distinct char selects a candidate, thus there is at most
+// 1 memcmp per line
+static inline
+Key uevent_key(const char *key, size_t len) {
+  switch (len) {
+  case 4:
+    if (KEY_IS("NAME")) return KEY_NAME;
+    break;
+  case 6:
+    if (key[0] == 'S' && KEY_IS("STATUS")) return KEY_STATUS;
+    if (key[0] == 'O' && KEY_IS("ONLINE")) return KEY_ONLINE;
+    break;
+  case 8:
+    if (KEY_IS("CAPACITY")) return KEY_CAPACITY;
+    break;
+  case 9:
+    if (KEY_IS("POWER_NOW")) return KEY_POWER_NOW;
+    break;
+  case 10:
+    if (key[0] == 'E' && KEY_IS("ENERGY_NOW")) return KEY_ENERGY_NOW;
+    if (key[0] == 'C' && KEY_IS("CHARGE_NOW")) return KEY_CHARGE_NOW;
+    break;
+  case 11:
+    switch (key[1]) {
+    case 'O': if (KEY_IS("VOLTAGE_NOW")) return KEY_VOLTAGE_NOW; break;
+    case 'U': if (KEY_IS("CURRENT_NOW")) return KEY_CURRENT_NOW; break;
+    case 'N': if (KEY_IS("ENERGY_FULL")) return KEY_ENERGY_FULL; break;
+    case 'H': if (KEY_IS("CHARGE_FULL")) return KEY_CHARGE_FULL; break;
+    }
+    break;
+  case 18:
+    if (key[0] == 'E' && KEY_IS("ENERGY_FULL_DESIGN"))
+      return KEY_ENERGY_FULL_DESIGN;
+    if (key[0] == 'C' && KEY_IS("CHARGE_FULL_DESIGN"))
+      return KEY_CHARGE_FULL_DESIGN;
+    break;
+  }
+  return KEY_UNKNOWN;
+}
+
+// like atol(3) but for a non NUL-terminated value
+static inline
+long parse_long(const char *p, const char *end) {
+  bool negative = false;
+  if (p < end && (*p == '-' || *p == '+')) negative = *p++ == '-';
+
+  long r = 0;
+  for (; p < end && *p >= '0' && *p <= '9'; ++p) r = r*10 + (*p - '0');
+  return negative ? -r : r;
+}
+
+// parse a uevent buffer in 1 pass, w/o copying the lines; sysfs
+// files separate records w/ '\n', netlink messages--w/ '\0'
 static
-bool parse_entry(char *file, Uevent *uevent) {
-  FILE *fp = fopen(file, "r");
-  if (!fp) return false;
-
-  char *line = NULL;
-  size_t line_size = 0;
-  while (getline(&line, &line_size, fp) != -1) {
-    char key[BUFSIZ], val[BUFSIZ];
-    sscanf(line, "%[^=]=%s", key, val);
-    //printf("'%s' = '%s'\n", key, val);
-
-    if (strcmp("POWER_SUPPLY_STATUS", key) == 0
-	&& strcasecmp("charging", val) == 0) uevent->is_charging = true;
-    if (strcmp("POWER_SUPPLY_CAPACITY", key) == 0) uevent->capacity = atoi(val);
-    if (strcmp("POWER_SUPPLY_VOLTAGE_NOW", key) == 0)
-      uevent->voltage = atoi(val);
-
-    if (strcmp("POWER_SUPPLY_POWER_NOW", key) == 0
-	|| strcmp("POWER_SUPPLY_CURRENT_NOW", key) == 0)
-      uevent->power = abs(atoi(val));
-    if (strcmp("POWER_SUPPLY_ENERGY_FULL", key) == 0
-	|| strcmp("POWER_SUPPLY_CHARGE_FULL", key) == 0)
-      uevent->energy_full = atoi(val);
-    if (strcmp("POWER_SUPPLY_ENERGY_FULL_DESIGN", key) == 0
-	|| strcmp("POWER_SUPPLY_CHARGE_FULL_DESIGN", key) == 0)
-      uevent->energy_full = atoi(val);
-
-    if (strcmp("POWER_SUPPLY_ENERGY_NOW", key) == 0) {
+void parse_buf(const char *buf, size_t len, char sep, Uevent *uevent) {
+  const char *end = buf + len;
+  const char *eol;
+  for (const char *line = buf; line < end; line = eol + 1) {
+    eol = memchr(line, sep, end - line);
+    if (!eol) eol = end;
+
+    const char *eq = memchr(line, '=', eol - line);
+    if (!eq || eq - line <= (long)KEY_PREFIX_LEN
+	|| memcmp(line, KEY_PREFIX, KEY_PREFIX_LEN) != 0) continue;
+
+    const char *key = line + KEY_PREFIX_LEN;
+    const char *val = eq + 1;
+    //printf("'%.*s' = '%.*s'\n", (int)(eq - key), key, (int)(eol - val), val);
+
+    switch (uevent_key(key, eq - key)) {
+    case KEY_STATUS:
+      if (eol - val == 8 && strncasecmp("charging", val, 8) == 0)
+	uevent->is_charging = true;
+      break;
+    case KEY_CAPACITY:
+      uevent->capacity = parse_long(val, eol);
+      break;
+    case KEY_VOLTAGE_NOW:
+      uevent->voltage = parse_long(val, eol);
+      break;
+    case KEY_POWER_NOW:
+    case KEY_CURRENT_NOW:
+      uevent->power = labs(parse_long(val, eol));
+      break;
+    case KEY_ENERGY_FULL:
+    case KEY_CHARGE_FULL:
+    case KEY_ENERGY_FULL_DESIGN:
+    case KEY_CHARGE_FULL_DESIGN:
+      uevent->energy_full = parse_long(val, eol);
+      break;
+    case KEY_ENERGY_NOW:
       uevent->is_mWh = true;
-      uevent->energy_now = atoi(val);
-    }
-    if (strcmp("POWER_SUPPLY_CHARGE_NOW", key) == 0) {
+      uevent->energy_now = parse_long(val, eol);
+      break;
+    case KEY_CHARGE_NOW:
       uevent->is_mWh = false;
-      uevent->energy_now = atoi(val);
+      uevent->energy_now = parse_long(val, eol);
+      break;
+    case KEY_NAME:
+      uevent->name = val;
+      uevent->name_len = eol - val;
+      break;
+    case KEY_ONLINE:
+      uevent->online = parse_long(val, eol);
+      break;
+    case KEY_UNKNOWN:
+      break;
     }
-
-    key[0] = '\0';
-    val[0] = '\0';
   }
-  free(line);
-  fclose(fp);
-  return true;
 }
 
-bool battery_get_from_file(char *file, Battery *bt) {
-  Uevent uevent;
-  uevent_init(&uevent);
-  if (!parse_entry(file, &uevent)) return false;
+static
+bool parse_entry(char *file, Uevent *uevent) {
+  int fd = open(file, O_RDONLY | O_CLOEXEC);
+  if (fd == -1) return false;
 
-  battery_init(bt);
-  bt->is_ac_power = ac_power() == 1;
-  bt->is_charging = uevent.is_charging;
-  bt->capacity = uevent.capacity;
+  char buf[BUFSIZ];
+  ssize_t len = read(fd, buf, sizeof(buf));
+  close(fd);
+  if (len == -1) return false;
 
-  if (uevent.energy_now > uevent.energy_full)
-    uevent.energy_now = uevent.energy_full;
-  if (uevent.energy_full == -1) uevent.energy_full = uevent.energy_full_design;
+  parse_buf(buf, len, '\n', uevent);
+  return true;
+}
+
+// bring the energy & power values to µWh & µW
+static
+void uevent_normalize(Uevent *uevent) {
+  if (uevent->energy_now > uevent->energy_full)
+    uevent->energy_now = uevent->energy_full;
+  if (uevent->energy_full == -1) uevent->energy_full = uevent->energy_full_design;
 
   // ENERGY_* attrs represents capacity in mWh;
   // CHARGE_* attrs represents capacity in mAh;
-  if (!uevent.is_mWh && uevent.voltage != -1) {
+  if (!uevent->is_mWh && uevent->voltage != -1) {
     // actually this is not necessary
-    uevent.power = mAh_to_mWh(uevent.voltage, uevent.power);
-    uevent.energy_now = mAh_to_mWh(uevent.voltage, uevent.energy_now);
-    uevent.energy_full = mAh_to_mWh(uevent.voltage, uevent.energy_full);
+    uevent->power = mAh_to_mWh(uevent->voltage, uevent->power);
+    uevent->energy_now = mAh_to_mWh(uevent->voltage, uevent->energy_now);
+    uevent->energy_full = mAh_to_mWh(uevent->voltage, uevent->energy_full);
+    uevent->is_mWh = true;
   }
+}
 
-  if (uevent.power > 0 && uevent.energy_now > 0 && uevent.energy_full > 0
+static
+void battery_compute(Uevent *uevent, int is_ac_power, Battery *bt) {
+  battery_init(bt);
+  bt->is_ac_power = is_ac_power == 1;
+  bt->is_charging = uevent->is_charging;
+  bt->capacity = uevent->capacity;
+
+  uevent_normalize(uevent);
+  bt->energy_now = uevent->energy_now;
+  bt->energy_full = uevent->energy_full;
+  bt->power = uevent->power;
+
+  if (uevent->power > 0 && uevent->energy_now > 0 && uevent->energy_full > 0
       && bt->capacity <= 100) {
     double hours;
     if (bt->is_charging) {
-      hours = (uevent.energy_full - uevent.energy_now) / (double)uevent.power;
+      hours = (uevent->energy_full - uevent->energy_now) / (double)uevent->power;
     } else {
-      hours = (double)uevent.energy_now / uevent.power;
+      hours = (double)uevent->energy_now / uevent->power;
     }
     bt->seconds_remaining = (int)(hours * 60*60);
   } else
     bt->seconds_remaining = 0;
 
-  if (uevent.energy_now > 0 && uevent.energy_full > 0) {
-    int percent = ((double)uevent.energy_now/uevent.energy_full)*100;
+  if (uevent->energy_now > 0 && uevent->energy_full > 0) {
+    int percent = ((double)uevent->energy_now/uevent->energy_full)*100;
     if (bt->capacity < 0 || bt->capacity >= 100) bt->capacity = percent;
   }
   if (bt->capacity > 100) bt->capacity = 100;
+}
+
+void battery_parse(const char *buf, size_t len, Battery *bt) {
+  Uevent uevent;
+  uevent_init(&uevent);
+  parse_buf(buf, len, '\n', &uevent);
+  battery_compute(&uevent, 0, bt);
+}
+
+bool battery_get_from_file(char *file, Battery *bt) {
+  Uevent uevent;
+  uevent_init(&uevent);
+  if (!parse_entry(file, &uevent)) return false;
+
+  battery_compute(&uevent, ac_power(), bt);
   return true;
 }
 
-int *battery_list() {
-  int *list = NULL;
-  glob_t gbuf;
+size_t battery_ids(int *ids, size_t size) {
+  const SupplyList *supplies = supply_list();
+  size_t count = 0;
+  for (size_t i = 0; i < supplies->count; ++i) {
+    if (!supply_is_battery(&supplies->items[i])) continue;
+    if (count < size) ids[count] = supplies->items[i].id;
+    count++;
+  }
+  return count;
+}
 
-  if (glob("/sys/class/power_supply/BAT*", 0, NULL, &gbuf) != 0)
-    return NULL;
+int *battery_list() {
+  size_t size = battery_ids(NULL, 0);
+  if (!size) return NULL;
 
-  size_t size = gbuf.gl_pathc;
-  list = malloc((size + 1) * sizeof(int));
-  for (size_t i = 0; i < size; ++i)
-    list[i] = atoi(basename(gbuf.gl_pathv[i])+3);
+  int *list = malloc((size + 1) * sizeof(int));
+  if (!list) return NULL;
+  battery_ids(list, size);
   list[size] = -1;
 
-  globfree(&gbuf);
   return list;
 }
+
+
+
+static bool use_uring = false;
+
+void battery_use_uring(bool yes) { use_uring = yes; }
+
+static bool session_read(BatterySession*);
+
+static
+void session_ac_close(BatterySession *s) {
+  for (size_t i = 0; i < s->ac_count; ++i) close(s->ac_fds[i]);
+  free(s->ac_fds);
+  free(s->ac_bufs);
+  s->ac_fds = NULL;
+  s->ac_bufs = NULL;
+  s->ac_count = 0;
+}
+
+static
+void session_ac_open(BatterySession *s) {
+  session_ac_close(s);
+
+  const SupplyList *list = supply_list();
+  s->ac_fds = malloc(list->count * sizeof(int));
+  s->ac_bufs = malloc(list->count ? list->count : 1);
+  if (!s->ac_fds || !s->ac_bufs) {
+    session_ac_close(s);
+    return;
+  }
+
+  for (size_t i = 0; i < list->count; ++i) {
+    if (!supply_is_adapter(&list->items[i])) continue;
+
+    char path[FILENAME_MAX];
+    supply_path(&list->items[i], "online", path, sizeof(path));
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd != -1) s->ac_fds[s->ac_count++] = fd;
+  }
+}
+
+static
+bool device_is_gone(int fd) {
+  return fd == -1 || errno == ENODEV || errno == ENOENT;
+}
+
+static
+void session_packs_close(BatterySession *s) {
+  for (size_t i = 0; i < s->count; ++i)
+    if (s->packs[i].fd != -1) close(s->packs[i].fd);
+  free(s->packs);
+  s->packs = NULL;
+  s->count = 0;
+}
+
+static
+bool pack_open(BatteryPack *pack, const Supply *bat) {
+  char path[FILENAME_MAX];
+  pack->id = bat->id;
+  strcpy(pack->name, bat->name);
+  supply_path(bat, "uevent", path, sizeof(path));
+  pack->fd = open(path, O_RDONLY | O_CLOEXEC);
+  return pack->fd != -1;
+}
+
+static
+void session_ring_close(BatterySession *s) {
+  uring_free(s->ring);
+  free(s->reads);
+  s->ring = NULL;
+  s->reads = NULL;
+}
+
+// pin the current packs & adapters to a new ring; w/o it, the reads
+// fall back to pread(2)
+static
+void session_ring_open(BatterySession *s) {
+  session_ring_close(s);
+  size_t n = s->count + s->ac_count;
+  if (!use_uring || !n) return;
+
+  s->ring = uring_new(n);
+  s->reads = malloc(n * sizeof(UringRead));
+  int *fds = malloc(n * sizeof(int));
+  if (!s->ring || !s->reads || !fds) goto fail;
+
+  struct iovec iov[] = {
+    { s->packs, s->count * sizeof(BatteryPack) },
+    { s->ac_bufs, s->ac_count }
+  };
+  for (size_t i = 0; i < s->count; ++i) {
+    fds[i] = s->packs[i].fd;
+    s->reads[i] = (UringRead){
+      .file = i, .buf_index = 0,
+      .buf = s->packs[i].buf, .size = sizeof(s->packs[i].buf)
+    };
+  }
+  for (size_t i = 0; i < s->ac_count; ++i) {
+    fds[s->count + i] = s->ac_fds[i];
+    s->reads[s->count + i] = (UringRead){
+      .file = s->count + i, .buf_index = 1,
+      .buf = &s->ac_bufs[i], .size = 1
+    };
+  }
+  // a zero-length iovec is rejected
+  if (!uring_register(s->ring, iov, s->ac_count ? 2 : 1, fds, n)) goto fail;
+  free(fds);
+  return;
+
+ fail:
+  free(fds);
+  session_ring_close(s);
+}
+
+// (re)open all the files from the current registry
+static
+bool session_reopen(BatterySession *s) {
+  s->generation = supply_list()->generation;
+  session_ac_open(s);
+  session_packs_close(s);
+  session_ring_close(s);
+
+  const SupplyList *list = supply_list();
+  s->packs = malloc((list->count ? list->count : 1) * sizeof(BatteryPack));
+  if (!s->packs) return false;
+
+  if (s->id == BATTERY_ALL) {
+    for (size_t i = 0; i < list->count; ++i)
+      if (supply_is_battery(&list->items[i])
+	  && pack_open(&s->packs[s->count], &list->items[i])) s->count++;
+  } else {
+    const Supply *bat = supply_find_battery(s->id);
+    if (bat && pack_open(&s->packs[0], bat)) s->count = 1;
+  }
+  session_ring_open(s);
+  return s->count > 0;
+}
+
+// all the packs & adapters in 1 io_uring_enter(2); return false if
+// a battery is gone
+static
+bool session_read_uring(BatterySession *s) {
+  uint64_t start = stats_now();
+  stats_count(COUNTER_SYSFS_SYSCALLS, 1);
+  if (!uring_read(s->ring, s->reads, s->count + s->ac_count)) {
+    session_ring_close(s);	// never again
+    return session_read(s);
+  }
+  stats_stage(STAGE_READ, start);
+
+  for (size_t i = 0; i < s->count; ++i) {
+    ssize_t len = s->reads[i].len;
+    s->packs[i].len = len < 0 ? -1 : len;
+    if (len == -ENODEV || len == -ENOENT) return false;
+  }
+
+  s->ac_power = s->ac_count ? 0 : -1;
+  for (size_t i = 0; i < s->ac_count; ++i) {
+    ssize_t len = s->reads[s->count + i].len;
+    if (len == -ENODEV || len == -ENOENT) {
+      // let battery_session_ac_power() rescan the adapters
+      s->ac_power = battery_session_ac_power(s);
+      break;
+    }
+    if (len == 1 && s->ac_bufs[i] == '1') s->ac_power = 1;
+  }
+  return true;
+}
+
+// read the uevent files of all the packs back to back, before any
+// parsing, & then the adapters; return false if a battery is gone
+static
+bool session_read(BatterySession *s) {
+  if (s->ring) return session_read_uring(s);
+
+  uint64_t start = stats_now();
+  stats_count(COUNTER_SYSFS_SYSCALLS, s->count);
+  for (size_t i = 0; i < s->count; ++i) {
+    BatteryPack *pack = &s->packs[i];
+    pack->len = pread(pack->fd, pack->buf, sizeof(pack->buf), 0);
+    if (pack->len == -1 && device_is_gone(pack->fd)) return false;
+  }
+  stats_stage(STAGE_READ, start);
+  s->ac_power = battery_session_ac_power(s);
+  return true;
+}
+
+// add up the packs into 1 big battery
+static
+void session_sum(BatterySession *s, Uevent *sum) {
+  uevent_init(sum);
+  sum->energy_now = sum->energy_full = sum->power = 0;
+  int capacity = 0, capacity_count = 0;
+  bool has_energy = false;
+
+  for (size_t i = 0; i < s->count; ++i) {
+    BatteryPack *pack = &s->packs[i];
+    if (pack->len == -1) continue;
+
+    Uevent uevent;
+    uevent_init(&uevent);
+    parse_buf(pack->buf, pack->len, '\n', &uevent);
+    uevent_normalize(&uevent);
+
+    if (uevent.is_charging) sum->is_charging = true;
+    if (uevent.capacity >= 0) {
+      capacity += uevent.capacity;
+      capacity_count++;
+    }
+    if (uevent.energy_now > 0 && uevent.energy_full > 0) {
+      sum->energy_now += uevent.energy_now;
+      sum->energy_full += uevent.energy_full;
+      has_energy = true;
+    }
+    // an idle pack reports 0
+    if (uevent.power > 0) sum->power += uevent.power;
+  }
+
+  if (!has_energy) {
+    sum->energy_now = sum->energy_full = -1;
+    // no choice but the average
+    if (capacity_count) sum->capacity = capacity / capacity_count;
+  }
+}
+
+static
+int session_ac_read(BatterySession *s) {
+  bool rescanned = false;
+  for (;;) {
+    bool gone = false;
+    for (size_t i = 0; i < s->ac_count; ++i) {
+      char ch;
+      stats_count(COUNTER_SYSFS_SYSCALLS, 1);
+      if (pread(s->ac_fds[i], &ch, 1, 0) != 1) {
+	if (device_is_gone(s->ac_fds[i])) gone = true;
+	continue;
+      }
+      if (ch == '1') return 1;
+    }
+    if (!gone || rescanned) break;
+
+    // an adapter was unplugged (a docking station?)
+    supply_rescan();
+    session_ac_open(s);
+    rescanned = true;
+  }
+  return s->ac_count ? 0 : -1;
+}
+
+// like ac_power() but w/o reopening the files every time
+int battery_session_ac_power(BatterySession *s) {
+  uint64_t start = stats_now();
+  int r = session_ac_read(s);
+  stats_stage(STAGE_AC_POWER, start);
+  return r;
+}
+
+bool battery_session_open(BatterySession *s, int id) {
+  s->id = id;
+  s->packs = NULL;
+  s->count = 0;
+  s->ac_fds = NULL;
+  s->ac_bufs = NULL;
+  s->ac_count = 0;
+  s->ring = NULL;
+  s->reads = NULL;
+  return session_reopen(s);
+}
+
+bool battery_session_get(BatterySession *s, Battery *bt) {
+  if (s->generation != supply_list()->generation) session_reopen(s);
+
+  // sysfs attributes are never larger than a page & are returned
+  // in 1 read
+  if (!s->count || !session_read(s)) {
+    // a battery was removed or replaced
+    supply_rescan();
+    if (!session_reopen(s) || !session_read(s)) return false;
+  }
+
+  Uevent uevent;
+  uint64_t start = stats_now();
+  if (s->id == BATTERY_ALL) {
+    session_sum(s, &uevent);
+  } else {
+    if (s->packs[0].len == -1) return false;
+    uevent_init(&uevent);
+    parse_buf(s->packs[0].buf, s->packs[0].len, '\n', &uevent);
+  }
+  stats_stage(STAGE_PARSE, start);
+
+  start = stats_now();
+  battery_compute(&uevent, s->ac_power, bt);
+  stats_stage(STAGE_COMPUTE, start);
+  bt->id = s->id;
+  return true;
+}
+
+bool battery_session_event(BatterySession *s, const char *msg, size_t len,
+			   Battery *bt) {
+  Uevent uevent;
+  uevent_init(&uevent);
+  parse_buf(msg, len, '\0', &uevent);
+
+  if (uevent.online != -1) {	// an ac adapter
+    // another adapter may be still online
+    bt->is_ac_power = uevent.online == 1 || battery_session_ac_power(s) == 1;
+    return true;
+  }
+
+  for (size_t i = 0; i < s->count; ++i) {
+    const char *name = s->packs[i].name;
+    if (uevent.name_len != strlen(name)
+	|| memcmp(uevent.name, name, uevent.name_len) != 0) continue;
+
+    // the sum needs the fresh values of the other packs too
+    if (s->id == BATTERY_ALL) return battery_session_get(s, bt);
+
+    battery_compute(&uevent, bt->is_ac_power, bt);
+    bt->id = s->id;
+    return true;
+  }
+  return false;
+}
+
+void battery_session_close(BatterySession *s) {
+  session_ring_close(s);
+  session_packs_close(s);
+  session_ac_close(s);
+}
@@ -2,6 +2,10 @@
 #define BATTERY_H
 
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <sys/types.h>
+#include "uring.h"
 
 typedef struct Battery {
   int id;
@@ -9,16 +13,73 @@ typedef struct Battery {
   bool is_charging;
   int capacity; // %
   int seconds_remaining;
+  // µWh & µW as in sysfs (CHARGE_* values are converted); -1 if
+  // unknown
+  long energy_now;
+  long energy_full;
+  long power;
 } Battery;
 
+// a session id: every battery at once, summed up
+#define BATTERY_ALL -2
+
+typedef struct BatteryPack {
+  int id;
+  char name[64];
+  int fd;			// uevent
+  char buf[BUFSIZ];
+  ssize_t len;			// of the last read, -1 on error
+} BatteryPack;
+
+// sysfs descriptors that are kept open between the updates;
+// the uevent & ac files are reread with pread(2) & reopened only
+// when the kernel says the device is gone
+typedef struct BatterySession {
+  int id;			// or BATTERY_ALL
+  BatteryPack *packs;
+  size_t count;
+  int *ac_fds;
+  char *ac_bufs;		// the last byte read from every "online"
+  size_t ac_count;
+  int ac_power;			// as battery_session_ac_power() returns
+  unsigned generation;		// of the supply registry
+  Uring *ring;			// NULL if the reads go through pread(2)
+  UringRead *reads;		// packs 1st, then the adapters
+} BatterySession;
+
 void battery_init(Battery*);
+// field by field, the padding doesn't count
+bool battery_equal(const Battery*, const Battery*);
 
 // return false on error
 bool battery_get(int, Battery*);
 // return false on error
 bool battery_get_from_file(char*, Battery*);
+// fill a Battery from a raw uevent buffer (KEY=VAL lines); the ac
+// status is set to false
+void battery_parse(const char*, size_t, Battery*);
 // return a -1-terminated array or NULL on error;
 // the result should be free()'ed
 int *battery_list();
+// write up to size ids into the array; return the number of all the
+// batteries
+size_t battery_ids(int*, size_t);
+
+// read all the files of a session w/ io_uring if the kernel
+// supports it or w/ pread(2) (the default); affects only the sessions
+// opened afterwards
+void battery_use_uring(bool);
+
+// return false if the battery (or, w/ BATTERY_ALL, every battery)
+// cannot be opened; the ac adapters are watched anyway
+bool battery_session_open(BatterySession*, int);
+// return false on error
+bool battery_session_get(BatterySession*, Battery*);
+// apply a kobject uevent message (NUL-separated KEY=VAL records)
+// about a power supply; return true if the battery was updated
+bool battery_session_event(BatterySession*, const char*, size_t, Battery*);
+// 1 if any adapter is online, 0 if none, -1 if there are no adapters
+int battery_session_ac_power(BatterySession*);
+void battery_session_close(BatterySession*);
 
 #endif
@@ -0,0 +1,193 @@
+// parse & compute every uevent from the command line (plus a
+// generated corpus) many times; print ns, allocations & cpu
+// instructions per uevent & fail if any of them exceeds the limits
+// from the -l file
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+#include <err.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include "../battery.h"
+
+typedef struct Entry {
+  char buf[BUFSIZ];
+  size_t len;
+} Entry;
+
+static unsigned long allocs = 0;
+
+// glibc's own allocator is reachable w/o dlsym(), which allocates
+extern void *__libc_malloc(size_t);
+extern void *__libc_calloc(size_t, size_t);
+extern void *__libc_realloc(void*, size_t);
+
+void *malloc(size_t size) { allocs++; return __libc_malloc(size); }
+void *calloc(size_t n, size_t size) { allocs++; return __libc_calloc(n, size); }
+void *realloc(void *p, size_t size) { allocs++; return __libc_realloc(p, size); }
+
+static
+double now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// -1 if perf_event_open(2) is unavailable
+static
+int instructions_open() {
+  struct perf_event_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = PERF_TYPE_HARDWARE;
+  attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+  attr.disabled = 1;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  return syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+static
+long long instructions_read(int fd) {
+  long long val;
+  return read(fd, &val, sizeof(val)) == sizeof(val) ? val : -1;
+}
+
+static
+void entry_read(Entry *e, const char *file) {
+  FILE *fp = fopen(file, "r");
+  if (!fp) err(1, "%s", file);
+  e->len = fread(e->buf, 1, sizeof(e->buf), fp);
+  fclose(fp);
+}
+
+static unsigned long seed = 1;
+
+static
+unsigned long lcg() {
+  seed = seed * 6364136223846793005UL + 1442695040888963407UL;
+  return seed >> 33;
+}
+
+// a variation of a real uevent: the numbers are scaled by 0.5-1.5 &
+// the irrelevant keys are appended up to a random size
+static
+void entry_generate(Entry *e, const Entry *base) {
+  e->len = 0;
+  const char *p = base->buf, *end = base->buf + base->len;
+  while (p < end) {
+    const char *eol = memchr(p, '\n', end - p);
+    if (!eol) eol = end;
+    const char *eq = memchr(p, '=', eol - p);
+    size_t room = sizeof(e->buf) - e->len;
+
+    if (eq && eq + 1 < eol && isdigit(eq[1])) {
+      long val = atol(eq + 1) * (50 + lcg() % 100) / 100;
+      e->len += snprintf(e->buf + e->len, room, "%.*s%ld\n",
+			 (int)(eq + 1 - p), p, val);
+    } else {
+      e->len += snprintf(e->buf + e->len, room, "%.*s\n", (int)(eol - p), p);
+    }
+    p = eol + 1;
+  }
+
+  int extra = lcg() % 32;
+  for (int i = 0; i < extra && e->len < sizeof(e->buf) - 64; ++i)
+    e->len += sprintf(e->buf + e->len, "POWER_SUPPLY_VENDOR_DATA_%d=%lu\n",
+		      i, lcg());
+}
+
+// "key max" lines; # starts a comment
+static
+int limits_check(const char *file, double ns, double allocs,
+		 double instructions) {
+  FILE *fp = fopen(file, "r");
+  if (!fp) err(1, "%s", file);
+
+  int failed = 0;
+  char line[256], key[64];
+  double max;
+  while (fgets(line, sizeof(line), fp)) {
+    if (line[0] == '#' || sscanf(line, "%63s %lf", key, &max) != 2) continue;
+
+    double val;
+    if (strcmp(key, "ns") == 0) val = ns;
+    else if (strcmp(key, "allocs") == 0) val = allocs;
+    else if (strcmp(key, "instructions") == 0) val = instructions;
+    else errx(1, "%s: unknown key '%s'", file, key);
+
+    if (val < 0) continue;	// wasn't measured
+    if (val > max) {
+      fprintf(stderr, "REGRESSION: %s/op is %.1f, the limit is %.1f\n",
+	      key, val, max);
+      failed = 1;
+    }
+  }
+  fclose(fp);
+  return failed;
+}
+
+int main(int argc, char *argv[])
+{
+  char *limits = NULL;
+  int opt;
+  while ( (opt = getopt(argc, argv, "l:")) != -1) {
+    if (opt == 'l') limits = optarg;
+    else return 1;
+  }
+  if (optind == argc) errx(1, "Usage: %s [-l limits] file.txt...", argv[0]);
+
+  int fixtures = argc - optind;
+  int generated = getenv("BENCH_CORPUS") ? atoi(getenv("BENCH_CORPUS")) : 4096;
+  int count = fixtures + generated;
+  Entry *corpus = malloc(count * sizeof(Entry));
+  if (!corpus) err(1, "malloc");
+  for (int i = 0; i < fixtures; ++i) entry_read(&corpus[i], argv[optind + i]);
+  for (int i = 0; i < generated; ++i)
+    entry_generate(&corpus[fixtures + i], &corpus[i % fixtures]);
+
+  long iterations = getenv("BENCH_N") ? atol(getenv("BENCH_N")) : 2000000;
+  Battery bt;
+  long checksum = 0;
+  for (long n = 0; n < count; ++n) { // warm up the caches
+    battery_parse(corpus[n].buf, corpus[n].len, &bt);
+    checksum += bt.capacity;
+  }
+
+  int perf = instructions_open();
+  unsigned long allocs_before = allocs;
+  if (perf != -1) ioctl(perf, PERF_EVENT_IOC_ENABLE, 0);
+  double start = now();
+  for (long n = 0; n < iterations; ++n) {
+    Entry *e = &corpus[n % count];
+    battery_parse(e->buf, e->len, &bt);
+    checksum += bt.capacity + bt.seconds_remaining;
+  }
+  double elapsed = now() - start;
+  if (perf != -1) ioctl(perf, PERF_EVENT_IOC_DISABLE, 0);
+
+  double ns = elapsed / iterations;
+  double allocs_op = (double)(allocs - allocs_before) / iterations;
+  double instructions = -1;
+  if (perf != -1) {
+    long long val = instructions_read(perf);
+    if (val >= 0) instructions = (double)val / iterations;
+  }
+
+  printf("%ld uevents (%d fixtures, %d generated), checksum %ld\n",
+	 iterations, fixtures, generated, checksum);
+  printf("%10.1f ns/op\n%10.2f allocs/op\n", ns, allocs_op);
+  if (instructions < 0)
+    printf("%10s instructions/op (no perf_event_open)\n", "n/a");
+  else
+    printf("%10.0f instructions/op\n", instructions);
+
+  free(corpus);
+  fflush(stdout);
+  return limits ? limits_check(limits, ns, allocs_op, instructions) : 0;
+}
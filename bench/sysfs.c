@@ -0,0 +1,154 @@
+// sample a fake /sys/class/power_supply w/ hundreds of supplies (a
+// rack ups/bbu host) through io_uring, pread(2) & the old
+// fopen/getline path; print the average time per sample
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <err.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "../battery.h"
+#include "../supply.h"
+
+static char root[] = "/tmp/wmvolt-bench.XXXXXX";
+static int batteries, adapters;
+
+static
+double now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static
+void file_write(const char *dir, const char *name, const char *text) {
+  char path[FILENAME_MAX];
+  snprintf(path, sizeof(path), "%s/%s/%s", root, dir, name);
+  FILE *fp = fopen(path, "w");
+  if (!fp || fputs(text, fp) == EOF || fclose(fp)) err(1, "%s", path);
+}
+
+static
+void tree_make(const char *uevent_file) {
+  char uevent[BUFSIZ];
+  FILE *fp = fopen(uevent_file, "r");
+  if (!fp) err(1, "%s", uevent_file);
+  uevent[fread(uevent, 1, sizeof(uevent) - 1, fp)] = '\0';
+  fclose(fp);
+
+  if (!mkdtemp(root)) err(1, "mkdtemp");
+  for (int i = 0; i < batteries + adapters; ++i) {
+    char dir[64], path[FILENAME_MAX];
+    bool is_battery = i < batteries;
+    snprintf(dir, sizeof(dir), is_battery ? "BAT%d" : "AC%d",
+	     is_battery ? i : i - batteries);
+    snprintf(path, sizeof(path), "%s/%s", root, dir);
+    if (mkdir(path, 0755)) err(1, "%s", path);
+    if (is_battery) {
+      file_write(dir, "type", "UPS\n");
+      file_write(dir, "uevent", uevent);
+    } else {
+      file_write(dir, "type", "Mains\n");
+      file_write(dir, "online", "0\n");
+    }
+  }
+}
+
+static
+void tree_rm() {
+  char cmd[FILENAME_MAX];
+  snprintf(cmd, sizeof(cmd), "rm -rf '%s'", root);
+  if (system(cmd)) warnx("failed to remove %s", root);
+}
+
+// what wmvolt did before the sessions
+static
+bool sample_stdio(Battery *bt) {
+  const SupplyList *list = supply_list();
+  char uevent[BUFSIZ], *line = NULL;
+  size_t size = 0;
+  int ac = 0;
+  for (size_t i = 0; i < list->count; ++i) {
+    char path[FILENAME_MAX];
+    const Supply *supply = &list->items[i];
+    supply_path(supply, supply_is_battery(supply) ? "uevent" : "online",
+		path, sizeof(path));
+    FILE *fp = fopen(path, "r");
+    if (!fp) return false;
+
+    if (supply_is_battery(supply)) {
+      size_t len = 0;
+      ssize_t n;
+      while ( (n = getline(&line, &size, fp)) != -1
+	      && len + n < sizeof(uevent)) {
+	memcpy(uevent + len, line, n);
+	len += n;
+      }
+      battery_parse(uevent, len, bt);
+    } else if (fgetc(fp) == '1') {
+      ac = 1;
+    }
+    fclose(fp);
+  }
+  free(line);
+  bt->is_ac_power = ac;
+  return true;
+}
+
+typedef bool (*sample_fn)(Battery*);
+
+static BatterySession session;
+
+static
+bool sample_session(Battery *bt) {
+  return battery_session_get(&session, bt);
+}
+
+static
+void run(const char *name, sample_fn sample, long iterations) {
+  Battery bt;
+  long checksum = 0;
+  double start = now();
+  for (long n = 0; n < iterations; ++n) {
+    if (!sample(&bt)) errx(1, "%s: sampling failed", name);
+    checksum += bt.capacity;
+  }
+  double elapsed = now() - start;
+  printf("%-14s %8.1f us/sample, %6.0f ns/supply (checksum %ld)\n", name,
+	 elapsed / iterations / 1000,
+	 elapsed / iterations / (batteries + adapters), checksum);
+}
+
+int main(int argc, char *argv[])
+{
+  if (argc != 2) errx(1, "Usage: %s file.txt", argv[0]);
+  int supplies = getenv("BENCH_SUPPLIES") ? atoi(getenv("BENCH_SUPPLIES")) : 300;
+  long iterations = getenv("BENCH_N") ? atol(getenv("BENCH_N")) : 2000;
+  batteries = supplies * 2 / 3;
+  adapters = supplies - batteries;
+
+  tree_make(argv[1]);
+  supply_set_root(root);
+  printf("%d batteries, %d adapters, %ld samples\n",
+	 batteries, adapters, iterations);
+
+  battery_use_uring(true);
+  if (!battery_session_open(&session, BATTERY_ALL)) errx(1, "no batteries");
+  if (session.ring)
+    run("io_uring", sample_session, iterations);
+  else
+    printf("io_uring       n/a\n");
+  battery_session_close(&session);
+
+  battery_use_uring(false);
+  if (!battery_session_open(&session, BATTERY_ALL)) errx(1, "no batteries");
+  run("pread", sample_session, iterations);
+  battery_session_close(&session);
+
+  run("fopen/getline", sample_stdio, iterations);
+
+  tree_rm();
+  return 0;
+}
@@ -23,9 +23,19 @@
  * modified by Seiichi SATO <ssato@sh.rim.or.jp>
  */
 
+#define _GNU_SOURCE
 #include <stdlib.h>
-#include <sys/select.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <sys/signalfd.h>
 #include "dockapp.h"
+#include "stats.h"
 
 #define WINDOWED_SIZE_W 64
 #define WINDOWED_SIZE_H 64
@@ -34,6 +44,7 @@
 Display	*display = NULL;
 Bool	dockapp_iswindowed = False;
 Bool	dockapp_isbrokenwm = False;
+unsigned long	dockapp_nrequests = 0;
 
 /* private */
 static Window	window = None;
@@ -44,6 +55,42 @@ static Atom	delete_win;
 static int	width, height;
 static int	offset_w, offset_h;
 
+/* the reactor: every descriptor is watched by 1 epoll instance */
+#define MAX_INPUTS 64
+typedef struct Input {
+    int			fd;		/* -1 if the slot is free */
+    dockapp_input_cb	cb;
+    void		*data;
+} Input;
+static Input	inputs[MAX_INPUTS];
+static Input	xinput = { -1, NULL, NULL };
+static int	epfd = -1;
+
+static int		timer_fd = -1;
+static dockapp_timer_cb	timer_cb;
+static void		*timer_data;
+
+static int		signal_fd = -1;
+static sigset_t		signal_mask;
+static struct {
+    dockapp_signal_cb	cb;
+    void		*data;
+} signals[_NSIG];
+
+static Bool
+reactor_add(Input *input)
+{
+    struct epoll_event ev;
+
+    if (epfd == -1 && (epfd = epoll_create1(EPOLL_CLOEXEC)) == -1)
+	return False;
+
+    ev.events = EPOLLIN;
+    ev.data.ptr = input;
+    return epoll_ctl(epfd, EPOLL_CTL_ADD, input->fd, &ev) == 0;
+}
+
+
 void
 dockapp_open_window(char *display_specified, char *appname,
 		    unsigned w, unsigned h, int argc, char **argv)
@@ -143,6 +190,13 @@ dockapp_open_window(char *display_specified, char *appname,
     depth = DefaultDepth(display, DefaultScreen(display));
     gc = DefaultGC(display, DefaultScreen(display));
 
+    /* X events are dispatched by wait_event() itself */
+    xinput.fd = ConnectionNumber(display);
+    if (!reactor_add(&xinput)) {
+	fprintf(stderr, "%s: can't watch the X connection!\n", argv[0]);
+	exit(1);
+    }
+
     XFlush(display);
 }
 
@@ -182,6 +236,9 @@ create_bg_pixmap(void)
 void
 dockapp_set_background(Pixmap pixmap)
 {
+    /* every request below counts, not the call */
+    unsigned long first = NextRequest(display);
+
     if (dockapp_iswindowed) {
 	Pixmap bg;
 	bg = create_bg_pixmap();
@@ -196,6 +253,7 @@ dockapp_set_background(Pixmap pixmap)
     }
     XClearWindow(display, icon_window);
     XFlush(display);
+    dockapp_nrequests += NextRequest(display) - first;
 }
 
 
@@ -211,9 +269,9 @@ dockapp_show(void)
 }
 
 
-Bool
-dockapp_xpm2pixmap(char **data, Pixmap *pixmap, Pixmap *mask,
-		   XpmColorSymbol * colorSymbol, unsigned int nsymbols)
+static Bool
+x_xpm2pixmap(char **data, Pixmap *pixmap, Pixmap *mask,
+	     XpmColorSymbol * colorSymbol, unsigned int nsymbols)
 {
     XpmAttributes xpmAttr;
     xpmAttr.valuemask = XpmCloseness;
@@ -234,8 +292,8 @@ dockapp_xpm2pixmap(char **data, Pixmap *pixmap, Pixmap *mask,
 }
 
 
-Pixmap
-dockapp_XCreatePixmap(int w, int h)
+static Pixmap
+x_create_pixmap(int w, int h)
 {
     return (XCreatePixmap(display, icon_window, w, h, depth));
 }
@@ -252,16 +310,16 @@ dockapp_setshape(Pixmap mask, int x_ofs, int y_ofs)
 }
 
 
-void
-dockapp_copyarea(Pixmap src, Pixmap dist, int x_src, int y_src, int w, int h,
-		 int x_dist, int y_dist)
+static void
+x_copyarea(Pixmap src, Pixmap dist, int x_src, int y_src, int w, int h,
+	   int x_dist, int y_dist)
 {
     XCopyArea(display, src, dist, gc, x_src, y_src, w, h, x_dist, y_dist);
 }
 
 
-void
-dockapp_copy2window (Pixmap src)
+static void
+x_copy2window(Pixmap src)
 {
     if (dockapp_isbrokenwm) {
 	XCopyArea(display, src, window, gc, 0, 0, width, height, offset_w,
@@ -274,58 +332,398 @@ dockapp_copy2window (Pixmap src)
 
 
 Bool
-dockapp_nextevent_or_timeout(XEvent *event, unsigned long miliseconds)
+dockapp_add_input(int fd, dockapp_input_cb cb, void *data)
 {
-    struct timeval timeout;
-    fd_set rset;
+    int i;
+
+    for (i = 0; i < MAX_INPUTS; i++) {
+	if (inputs[i].cb)
+	    continue;
+	inputs[i].fd = fd;
+	inputs[i].cb = cb;
+	inputs[i].data = data;
+	if (reactor_add(&inputs[i]))
+	    return True;
+	inputs[i].cb = NULL;
+	return False;
+    }
+    return False;
+}
 
-    XSync(display, False);
-    if (XPending(display)) {
-	XNextEvent(display, event);
-	return True;
+
+void
+dockapp_remove_input(int fd)
+{
+    int i;
+
+    for (i = 0; i < MAX_INPUTS; i++) {
+	if (inputs[i].cb && inputs[i].fd == fd) {
+	    epoll_ctl(epfd, EPOLL_CTL_DEL, fd, NULL);
+	    /* the slot may be in the current epoll_wait() batch */
+	    inputs[i].fd = -1;
+	    inputs[i].cb = NULL;
+	}
     }
+}
 
-    timeout.tv_sec = miliseconds / 1000;
-    timeout.tv_usec = (miliseconds % 1000) * 1000;
 
-    FD_ZERO(&rset);
-    FD_SET(ConnectionNumber(display), &rset);
-    if (select(ConnectionNumber(display)+1, &rset, NULL, NULL, &timeout) > 0) {
-	XNextEvent(display, event);
-	if (event->type == ClientMessage) {
-	    if (event->xclient.data.l[0] == delete_win) {
-		XDestroyWindow(display,event->xclient.window);
-		XCloseDisplay(display);
-		exit(0);
-	    }
+static void
+on_timer(int fd, void *data)
+{
+    uint64_t expirations;
+
+    if (read(fd, &expirations, sizeof(expirations)) != sizeof(expirations))
+	return;
+    timer_cb(timer_data);
+}
+
+
+Bool
+dockapp_set_timer(unsigned long miliseconds, dockapp_timer_cb cb, void *data)
+{
+    struct itimerspec spec;
+    struct timespec now;
+
+    if (timer_fd == -1) {
+	timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+	if (timer_fd == -1)
+	    return False;
+	if (!dockapp_add_input(timer_fd, on_timer, NULL)) {
+	    close(timer_fd);
+	    timer_fd = -1;
+	    return False;
 	}
-	if (dockapp_iswindowed) {
-		event->xbutton.x -= offset_w;
-		event->xbutton.y -= offset_h;
+    }
+    timer_cb = cb;
+    timer_data = data;
+
+    /* an absolute schedule: the events in between don't shift it.
+       timerfd ignores the timer slack & epoll waits w/o a timeout, so
+       the only coalescing we get is from aligning the whole-second
+       intervals to whole seconds, where the other periodic timers of
+       the system tend to fire too */
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    spec.it_interval.tv_sec = miliseconds / 1000;
+    spec.it_interval.tv_nsec = (miliseconds % 1000) * 1000000;
+    spec.it_value.tv_sec = now.tv_sec + spec.it_interval.tv_sec;
+    spec.it_value.tv_nsec = now.tv_nsec + spec.it_interval.tv_nsec;
+    if (spec.it_value.tv_nsec >= 1000000000) {
+	spec.it_value.tv_sec++;
+	spec.it_value.tv_nsec -= 1000000000;
+    }
+    if (spec.it_interval.tv_nsec == 0 && spec.it_value.tv_nsec) {
+	spec.it_value.tv_sec++;
+	spec.it_value.tv_nsec = 0;
+    }
+    return timerfd_settime(timer_fd, TFD_TIMER_ABSTIME, &spec, NULL) == 0;
+}
+
+
+static void
+on_signal(int fd, void *data)
+{
+    struct signalfd_siginfo info;
+
+    while (read(fd, &info, sizeof(info)) == sizeof(info)) {
+	if (info.ssi_signo < _NSIG && signals[info.ssi_signo].cb)
+	    signals[info.ssi_signo].cb(info.ssi_signo,
+				       signals[info.ssi_signo].data);
+    }
+}
+
+
+Bool
+dockapp_add_signal(int sig, dockapp_signal_cb cb, void *data)
+{
+    int fd;
+
+    if (sig <= 0 || sig >= _NSIG)
+	return False;
+    signals[sig].cb = cb;
+    signals[sig].data = data;
+
+    if (signal_fd == -1)
+	sigemptyset(&signal_mask);
+    sigaddset(&signal_mask, sig);
+    /* the signal is delivered only through the descriptor now */
+    sigprocmask(SIG_BLOCK, &signal_mask, NULL);
+
+    fd = signalfd(signal_fd, &signal_mask, SFD_CLOEXEC | SFD_NONBLOCK);
+    if (fd == -1)
+	return False;
+    if (signal_fd == -1) {
+	signal_fd = fd;
+	if (!dockapp_add_input(signal_fd, on_signal, NULL))
+	    return False;
+    }
+    return True;
+}
+
+
+static int
+ms_until(struct timespec *deadline)
+{
+    struct timespec now;
+    long ms;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    ms = (deadline->tv_sec - now.tv_sec) * 1000
+	+ (deadline->tv_nsec - now.tv_nsec) / 1000000;
+    return ms < 0 ? 0 : ms;
+}
+
+
+/* dispatch the inputs until an X event arrives; -1 waits forever;
+   w/o a display there are only the inputs */
+static Bool
+wait_event(XEvent *event, long miliseconds)
+{
+    struct epoll_event ev[MAX_INPUTS + 1];
+    struct timespec deadline;
+    int i, n;
+    Bool x_ready;
+
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    if (miliseconds > 0) {
+	deadline.tv_sec += miliseconds / 1000;
+	deadline.tv_nsec += (miliseconds % 1000) * 1000000;
+	if (deadline.tv_nsec >= 1000000000) {
+	    deadline.tv_sec++;
+	    deadline.tv_nsec -= 1000000000;
 	}
-	return True;
     }
 
+    /* never XSync() here: over a remote X connection every round trip
+       costs a network latency */
+    while (!display || !XEventsQueued(display, QueuedAlready)) {
+	if (display) {
+	    uint64_t start = stats_now();
+	    XFlush(display);
+	    stats_stage(STAGE_FLUSH, start);
+	}
+
+	stats_count(COUNTER_WAITS, 1);
+	n = epoll_wait(epfd, ev, MAX_INPUTS + 1,
+		       miliseconds < 0 ? -1 : ms_until(&deadline));
+	if (n == -1 && errno == EINTR)
+	    continue;
+	if (n <= 0)
+	    return False;
+
+	x_ready = False;
+	for (i = 0; i < n; i++) {
+	    Input *input = ev[i].data.ptr;
+	    if (input == &xinput)
+		x_ready = True;
+	    else if (input->cb)
+		input->cb(input->fd, input->data);
+	}
+
+	/* read w/o blocking; the data may be a part of an event only */
+	if (x_ready && XEventsQueued(display, QueuedAfterReading))
+	    break;
+    }
+
+    XNextEvent(display, event);
+    if (event->type == ClientMessage) {
+	if (event->xclient.data.l[0] == delete_win) {
+	    XDestroyWindow(display,event->xclient.window);
+	    XCloseDisplay(display);
+	    exit(0);
+	}
+    }
+    if (dockapp_iswindowed) {
+	    event->xbutton.x -= offset_w;
+	    event->xbutton.y -= offset_h;
+    }
+    return True;
+}
+
+
+Bool
+dockapp_nextevent_or_timeout(XEvent *event, unsigned long miliseconds)
+{
+    return wait_event(event, miliseconds);
+}
+
+
+void
+dockapp_run(dockapp_event_cb cb, void *data)
+{
+    XEvent event;
+
+    for (;;)
+	if (wait_event(&event, -1))
+	    cb(&event, data);
+}
+
+
+/* colors are looked up once; a TrueColor pixel is computed from the
+   visual masks w/o asking the server */
+#define MAX_COLORS 16
+static struct {
+    char	  name[32];
+    Bool	  blended;
+    int		  r, g, b;
+    float	  fac;
+    unsigned long pixel;
+} colors[MAX_COLORS];
+static int	ncolors = 0;
+
+
+static int
+color_find(char *name, Bool blended, int r, int g, int b, float fac,
+	   unsigned long *pixel)
+{
+    int i;
+
+    for (i = 0; i < ncolors; i++) {
+	if (colors[i].blended == blended && colors[i].r == r
+	    && colors[i].g == g && colors[i].b == b && colors[i].fac == fac
+	    && strcmp(colors[i].name, name) == 0) {
+	    *pixel = colors[i].pixel;
+	    return True;
+	}
+    }
     return False;
 }
 
 
+static unsigned long
+color_add(char *name, Bool blended, int r, int g, int b, float fac,
+	  unsigned long pixel)
+{
+    if (ncolors < MAX_COLORS && strlen(name) < sizeof(colors[0].name)) {
+	strcpy(colors[ncolors].name, name);
+	colors[ncolors].blended = blended;
+	colors[ncolors].r = r;
+	colors[ncolors].g = g;
+	colors[ncolors].b = b;
+	colors[ncolors].fac = fac;
+	colors[ncolors].pixel = pixel;
+	ncolors++;
+    }
+    return pixel;
+}
+
+
+/* scale a 16-bit channel into its place in a TrueColor pixel */
+static unsigned long
+color_channel(unsigned short value, unsigned long mask)
+{
+    int shift = 0, bits = 0;
+
+    if (!mask)
+	return 0;
+    while (!(mask & 1)) {
+	mask >>= 1;
+	shift++;
+    }
+    while (mask & 1) {
+	mask >>= 1;
+	bits++;
+    }
+    return ((unsigned long)value >> (16 - bits)) << shift;
+}
+
+
+static Bool
+x_alloc_color(XColor *color)
+{
+    Visual *visual = DefaultVisual(display, DefaultScreen(display));
+
+    if (visual->class == TrueColor) {
+	color->pixel = color_channel(color->red, visual->red_mask)
+	    | color_channel(color->green, visual->green_mask)
+	    | color_channel(color->blue, visual->blue_mask);
+	return True;
+    }
+    return XAllocColor(display, DefaultColormap(display, DefaultScreen(display)),
+		       color);
+}
+
+
+static Bool
+x_parse_color(char *name, XColor *color)
+{
+    return XParseColor(display,
+		       DefaultColormap(display, DefaultScreen(display)),
+		       name, color);
+}
+
+
+static int
+x_depth(void)
+{
+    return DefaultDepth(display, DefaultScreen(display));
+}
+
+
+static const DockappBackend x_backend = {
+    x_xpm2pixmap, x_create_pixmap, x_copyarea, x_copy2window,
+    x_parse_color, x_alloc_color, x_depth
+};
+static const DockappBackend *backend = &x_backend;
+
+
+void
+dockapp_set_backend(const DockappBackend *b)
+{
+    backend = b;
+}
+
+
+Bool
+dockapp_xpm2pixmap(char **data, Pixmap *pixmap, Pixmap *mask,
+		   XpmColorSymbol * colorSymbol, unsigned int nsymbols)
+{
+    return backend->xpm2pixmap(data, pixmap, mask, colorSymbol, nsymbols);
+}
+
+
+Pixmap
+dockapp_XCreatePixmap(int w, int h)
+{
+    return backend->create_pixmap(w, h);
+}
+
+
+void
+dockapp_copyarea(Pixmap src, Pixmap dist, int x_src, int y_src, int w, int h,
+		 int x_dist, int y_dist)
+{
+    backend->copyarea(src, dist, x_src, y_src, w, h, x_dist, y_dist);
+    dockapp_nrequests++;
+}
+
+
+void
+dockapp_copy2window(Pixmap src)
+{
+    backend->copy2window(src);
+    dockapp_nrequests++;
+}
+
+
 unsigned long
 dockapp_getcolor(char *color_name)
 {
     XColor color;
+    unsigned long pixel;
 
-    if (!XParseColor(display, DefaultColormap(display, DefaultScreen(display)),
-		     color_name, &color))
+    if (color_find(color_name, False, 0, 0, 0, 0, &pixel))
+	return pixel;
+
+    /* only a color name, not a #rgb spec, makes a round trip */
+    if (!backend->parse_color(color_name, &color))
 	fprintf(stderr, "can't parse color %s\n", color_name), exit(1);
 
-    if (!XAllocColor(display, DefaultColormap(display, DefaultScreen(display)),
-		     &color)) {
+    if (!backend->alloc_color(&color)) {
 	fprintf(stderr, "can't allocate color %s. Using black\n", color_name);
 	return BlackPixel(display, DefaultScreen(display));
     }
 
-    return color.pixel;
+    return color_add(color_name, False, 0, 0, 0, 0, color.pixel);
 }
 
 
@@ -333,29 +731,33 @@ unsigned long
 dockapp_blendedcolor(char *color_name, int r, int g, int b, float fac)
 {
     XColor color;
+    unsigned long pixel;
+    int r0 = r, g0 = g, b0 = b;
 
     if ((r < -255 || r > 255)||(g < -255 || g > 255)||(b < -255 || b > 255)){
 	fprintf(stderr, "r:%d,g:%d,b:%d (r,g,b must be 0 to 255)", r, g, b);
 	exit(1);
     }
 
+    if (color_find(color_name, True, r0, g0, b0, fac, &pixel))
+	return pixel;
+
     r *= 255;
     g *= 255;
     b *= 255;
 
-    if (!XParseColor(display, DefaultColormap(display, DefaultScreen(display)),
-		     color_name, &color))
+    if (!backend->parse_color(color_name, &color))
 	fprintf(stderr, "can't parse color %s\n", color_name), exit(1);
 
-    if (!XAllocColor(display, DefaultColormap(display, DefaultScreen(display)),
-		     &color)) {
-	fprintf(stderr, "can't allocate color %s. Using black\n", color_name);
-	return BlackPixel(display, DefaultScreen(display));
+    if (backend->depth() < 16) {
+	if (!backend->alloc_color(&color)) {
+	    fprintf(stderr, "can't allocate color %s. Using black\n",
+		    color_name);
+	    return BlackPixel(display, DefaultScreen(display));
+	}
+	return color_add(color_name, True, r0, g0, b0, fac, color.pixel);
     }
 
-    if (DefaultDepth(display, DefaultScreen(display)) < 16)
-	return color.pixel;
-
     /* red */
     if (color.red + r > 0xffff) {
 	color.red = 0xffff;
@@ -385,11 +787,10 @@ dockapp_blendedcolor(char *color_name, int r, int g, int b, float fac)
 
     color.flags = DoRed | DoGreen | DoBlue;
 
-    if (!XAllocColor(display, DefaultColormap(display, DefaultScreen(display)),
-		     &color)) {
+    if (!backend->alloc_color(&color)) {
 	fprintf(stderr, "can't allocate color %s. Using black\n", color_name);
 	return BlackPixel(display, DefaultScreen(display));
     }
 
-    return color.pixel;
+    return color_add(color_name, True, r0, g0, b0, fac, color.pixel);
 }
@@ -73,13 +73,36 @@
 /* We are in trouble. */
 #endif
 
+typedef void (*dockapp_input_cb)(int fd, void *data);
+typedef void (*dockapp_timer_cb)(void *data);
+typedef void (*dockapp_signal_cb)(int sig, void *data);
+typedef void (*dockapp_event_cb)(XEvent *event, void *data);
+
+/* the drawing primitives: X11 unless another backend is set before
+   anything is drawn */
+typedef struct DockappBackend {
+    Bool	    (*xpm2pixmap)(char **data, Pixmap *pixmap, Pixmap *mask,
+				  XpmColorSymbol *symbols, unsigned nsymbols);
+    Pixmap	    (*create_pixmap)(int w, int h);
+    void	    (*copyarea)(Pixmap src, Pixmap dist, int x_src, int y_src,
+				int w, int h, int x_dist, int y_dist);
+    void	    (*copy2window)(Pixmap src);
+    Bool	    (*parse_color)(char *name, XColor *color);
+    Bool	    (*alloc_color)(XColor *color);
+    int		    (*depth)(void);
+} DockappBackend;
+
 extern Display *display;
 extern Bool dockapp_iswindowed;
 extern Bool dockapp_isbrokenwm;
+/* the drawing requests sent so far: 1 per copyarea/copy2window & all
+   the requests of a set_background */
+extern unsigned long dockapp_nrequests;
 
 
 void dockapp_open_window(char *display_specified, char *appname,
 			 unsigned w, unsigned h, int argc, char **argv);
+void dockapp_set_backend(const DockappBackend *backend);
 void dockapp_set_eventmask(long mask);
 void dockapp_set_background(Pixmap pixmap);
 void dockapp_show(void);
@@ -91,6 +114,12 @@ void dockapp_setshape(Pixmap mask, int x_ofs, int y_ofs);
 void dockapp_copyarea(Pixmap src, Pixmap dist, int x_src, int y_src,
 		      int w, int h, int x_dist, int y_dist);
 void dockapp_copy2window(Pixmap src);
+Bool dockapp_add_input(int fd, dockapp_input_cb cb, void *data);
+void dockapp_remove_input(int fd);
+Bool dockapp_set_timer(unsigned long miliseconds, dockapp_timer_cb cb,
+		       void *data);
+Bool dockapp_add_signal(int sig, dockapp_signal_cb cb, void *data);
 Bool dockapp_nextevent_or_timeout(XEvent * event, unsigned long miliseconds);
+void dockapp_run(dockapp_event_cb cb, void *data);
 unsigned long dockapp_getcolor(char *color);
 unsigned long dockapp_blendedcolor(char *color, int r, int g, int b, float fac);
@@ -0,0 +1,106 @@
+#include <math.h>
+#include "estimator.h"
+
+// the slope is trusted only over a long enough window
+#define MIN_SPAN 60		// sec
+
+void estimator_init(Estimator *e, double alpha) {
+  e->alpha = alpha;
+  estimator_reset(e);
+}
+
+void estimator_reset(Estimator *e) {
+  e->head = 0;
+  e->count = 0;
+  e->t0 = 0;
+  e->sum_t = e->sum_e = e->sum_tt = e->sum_te = 0;
+  e->ewma_power = -1;
+  e->is_charging = false;
+}
+
+static
+void sums_update(Estimator *e, const EstimatorSample *s, int sign) {
+  double t = s->t - e->t0;
+  e->sum_t += sign * t;
+  e->sum_e += sign * s->energy;
+  e->sum_tt += sign * t*t;
+  e->sum_te += sign * t*s->energy;
+}
+
+static
+const EstimatorSample *oldest(const Estimator*);
+
+// move t0 to the oldest sample & recompute the sums, once per a pass
+// of the ring: the offsets stay within the window however long we
+// run, & the rounding errors of the evictions don't pile up
+static
+void rebase(Estimator *e) {
+  e->t0 = oldest(e)->t;
+  e->sum_t = e->sum_e = e->sum_tt = e->sum_te = 0;
+  for (size_t i = 0; i < e->count; i++)
+    sums_update(e, &e->ring[(e->head + ESTIMATOR_WINDOW - e->count + i)
+			    % ESTIMATOR_WINDOW], 1);
+}
+
+void estimator_add(Estimator *e, double t, const Battery *bt) {
+  if (bt->energy_now < 0) return;
+
+  // the slope of a charge tells nothing about a discharge
+  if (e->count && e->is_charging != bt->is_charging) estimator_reset(e);
+  e->is_charging = bt->is_charging;
+  if (!e->count) e->t0 = t;
+
+  if (e->count == ESTIMATOR_WINDOW) { // evict the oldest
+    sums_update(e, &e->ring[e->head], -1);
+    e->count--;
+  }
+  EstimatorSample *s = &e->ring[e->head];
+  s->t = t;
+  s->energy = bt->energy_now;
+  s->power = bt->power;
+  sums_update(e, s, 1);
+  e->head = (e->head + 1) % ESTIMATOR_WINDOW;
+  e->count++;
+  if (!e->head) rebase(e);
+
+  if (bt->power > 0)
+    e->ewma_power = e->ewma_power < 0 ? bt->power
+      : e->alpha * bt->power + (1 - e->alpha) * e->ewma_power;
+}
+
+static
+const EstimatorSample *oldest(const Estimator *e) {
+  return &e->ring[(e->head + ESTIMATOR_WINDOW - e->count) % ESTIMATOR_WINDOW];
+}
+
+static
+const EstimatorSample *newest(const Estimator *e) {
+  return &e->ring[(e->head + ESTIMATOR_WINDOW - 1) % ESTIMATOR_WINDOW];
+}
+
+double estimator_rate(const Estimator *e) {
+  if (e->count >= 2 && newest(e)->t - oldest(e)->t >= MIN_SPAN) {
+    double n = e->count;
+    double d = n * e->sum_tt - e->sum_t * e->sum_t;
+    if (d > 0) {
+      double slope = (n * e->sum_te - e->sum_t * e->sum_e) / d; // µWh/sec
+      double rate = fabs(slope) * 3600;
+      if (rate > 0) return rate;
+    }
+  }
+  // not enough history or the energy doesn't move yet
+  return e->ewma_power > 0 ? e->ewma_power : 0;
+}
+
+void estimator_apply(const Estimator *e, Battery *bt) {
+  double rate = estimator_rate(e);
+  if (rate <= 0 || bt->energy_now <= 0 || bt->energy_full <= 0) return;
+  // the raw mode has the power value yet refuses to estimate (a full
+  // or a bogus battery)
+  if (!bt->seconds_remaining && bt->power > 0) return;
+
+  double left = bt->is_charging ? bt->energy_full - bt->energy_now
+    : bt->energy_now;
+  if (left <= 0) return;
+  bt->seconds_remaining = (int)(left / rate * 60*60);
+}
@@ -0,0 +1,39 @@
+#ifndef ESTIMATOR_H
+#define ESTIMATOR_H
+
+#include <stddef.h>
+#include "battery.h"
+
+#define ESTIMATOR_WINDOW 64	// samples
+
+typedef struct EstimatorSample {
+  double t;			// sec
+  double energy;		// µWh
+  double power;			// µW
+} EstimatorSample;
+
+// a sliding window of the latest samples; the sums for the
+// least-squares slope of energy(t) are updated in O(1) per sample
+// (amortized)
+typedef struct Estimator {
+  EstimatorSample ring[ESTIMATOR_WINDOW];
+  size_t head;
+  size_t count;
+  double t0;			// the oldest sample, keeps the sums small
+  double sum_t, sum_e, sum_tt, sum_te;
+  double ewma_power;
+  double alpha;			// the EWMA weight of a new sample
+  bool is_charging;
+} Estimator;
+
+void estimator_init(Estimator*, double);
+void estimator_reset(Estimator*);
+// ignore a sample w/o energy_now
+void estimator_add(Estimator*, double, const Battery*);
+// µW; a positive value drains the battery; 0 if unknown
+double estimator_rate(const Estimator*);
+// recompute bt->seconds_remaining from the window; leave it intact if
+// there is not enough data
+void estimator_apply(const Estimator*, Battery*);
+
+#endif
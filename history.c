@@ -0,0 +1,112 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "history.h"
+
+#define MAGIC "wmvoltH"
+#define VERSION 1
+
+typedef struct Header {
+  char magic[8];
+  uint32_t version;
+  uint32_t sample_size;
+  uint32_t size;		// samples in the ring
+  uint32_t pad;
+  uint64_t count;		// ever appended; the next goes to count % size
+} Header;
+
+static struct {
+  Header *header;
+  HistorySample *ring;
+} history;
+
+const char *history_default_path() {
+  static char path[FILENAME_MAX];
+  const char *state = getenv("XDG_STATE_HOME");
+  const char *home = getenv("HOME");
+  if (state && *state)
+    snprintf(path, sizeof(path), "%s/wmvolt/history.bin", state);
+  else if (home && *home)
+    snprintf(path, sizeof(path), "%s/.local/state/wmvolt/history.bin", home);
+  else
+    return NULL;
+  return path;
+}
+
+// mkdir -p for the dir of a file
+static
+bool mkdirs(const char *file) {
+  char dir[FILENAME_MAX];
+  snprintf(dir, sizeof(dir), "%s", file);
+  for (char *p = dir + 1; *p; p++) {
+    if (*p != '/') continue;
+    *p = '\0';
+    if (mkdir(dir, 0700) == -1 && errno != EEXIST) return false;
+    *p = '/';
+  }
+  return true;
+}
+
+bool history_open(const char *path) {
+  if (!mkdirs(path)) return false;
+  int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+  if (fd == -1) return false;
+
+  size_t len = sizeof(Header) + HISTORY_SIZE * sizeof(HistorySample);
+  void *p = MAP_FAILED;
+  if (ftruncate(fd, len) == 0)
+    p = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (p == MAP_FAILED) return false;
+
+  Header *h = p;
+  if (memcmp(h->magic, MAGIC, sizeof(h->magic)) || h->version != VERSION
+      || h->sample_size != sizeof(HistorySample) || h->size != HISTORY_SIZE) {
+    memset(h, 0, sizeof(Header));
+    memcpy(h->magic, MAGIC, sizeof(h->magic));
+    h->version = VERSION;
+    h->sample_size = sizeof(HistorySample);
+    h->size = HISTORY_SIZE;
+  }
+  history.header = h;
+  history.ring = (HistorySample*)(h + 1);
+  return true;
+}
+
+uint64_t history_count() {
+  return history.header ? history.header->count : 0;
+}
+
+const HistorySample *history_get(uint64_t n) {
+  uint64_t count = history_count();
+  if (n >= count || count - n > HISTORY_SIZE) return NULL;
+  return &history.ring[n % HISTORY_SIZE];
+}
+
+bool history_add(const Battery *bt) {
+  if (!history.header) return false;
+
+  time_t now = time(NULL);
+  const HistorySample *last = history_get(history_count() - 1);
+  // a clock that went back doesn't stop the history
+  if (last && now >= last->time && now - last->time < HISTORY_INTERVAL)
+    return false;
+
+  HistorySample *s = &history.ring[history.header->count % HISTORY_SIZE];
+  s->time = now;
+  s->energy_now = bt->energy_now < 0 ? -1 : bt->energy_now / 1000;
+  s->power = bt->power < 0 ? -1 : bt->power / 1000;
+  s->capacity = bt->capacity;
+  s->flags = (bt->is_ac_power ? HISTORY_AC : 0)
+    | (bt->is_charging ? HISTORY_CHARGING : 0);
+  // the sample 1st, so that a crash in between loses only it
+  history.header->count++;
+  return true;
+}
@@ -0,0 +1,40 @@
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "battery.h"
+
+// a ring of the past samples in an mmap'ed file that outlives the
+// process; a sample is stored w/ a plain memory write, the kernel
+// writes the pages back whenever it likes
+#define HISTORY_INTERVAL 300	// sec between the samples
+#define HISTORY_SIZE 8640	// samples, 30 days
+
+#define HISTORY_AC 1
+#define HISTORY_CHARGING 2
+
+typedef struct __attribute__((packed)) HistorySample {
+  int64_t time;			// unix sec
+  int32_t energy_now;		// mWh, -1 if unknown
+  int32_t power;		// mW, -1 if unknown
+  int8_t capacity;		// %
+  uint8_t flags;		// HISTORY_AC | HISTORY_CHARGING
+} HistorySample;
+
+// $XDG_STATE_HOME/wmvolt/history.bin or ~/.local/state/...; a static
+// buffer, NULL if there's no $HOME
+const char *history_default_path();
+
+// map the file, creating it & its dir if needed; a file of another
+// version or size is started anew; return false on error
+bool history_open(const char*);
+// append a sample if the last one is HISTORY_INTERVAL old; return
+// true if it was appended
+bool history_add(const Battery*);
+// the number of the samples ever appended
+uint64_t history_count();
+// sample #n, NULL if it's not in the ring anymore (or yet)
+const HistorySample *history_get(uint64_t);
+
+#endif
@@ -0,0 +1,174 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdint.h>
+#include <errno.h>
+#include <string.h>
+#include <signal.h>
+#include <spawn.h>
+#include <unistd.h>
+#include <err.h>
+#include <sys/syscall.h>
+#include <sys/timerfd.h>
+#include <sys/wait.h>
+#include "dockapp.h"
+#include "hook.h"
+
+#ifndef P_PIDFD
+#define P_PIDFD 3
+#endif
+
+typedef struct Hook {
+  pid_t pid;			// 0 if the slot is free
+  int pidfd;			// -1 w/o pidfd support
+  int timer;			// a timerfd for the timeout
+  bool killed;
+  char cmd[1024];
+} Hook;
+
+static Hook hooks[HOOK_MAX_RUNNING];
+
+extern char **environ;
+
+// %s -> the capacity, %% -> %; w/o printf() on a user string
+static
+bool expand(char *dest, size_t size, const char *template, int capacity) {
+  char num[16];
+  snprintf(num, sizeof(num), "%d", capacity);
+
+  size_t len = 0;
+  for (const char *p = template; *p; ++p) {
+    const char *add = p;
+    size_t n = 1;
+    if (p[0] == '%' && p[1] == 's') {
+      add = num;
+      n = strlen(num);
+      p++;
+    } else if (p[0] == '%' && p[1] == '%') {
+      p++;
+    }
+    if (len + n >= size) return false;
+    memcpy(dest + len, add, n);
+    len += n;
+  }
+  dest[len] = '\0';
+  return true;
+}
+
+static
+void hook_done(Hook *h, int status) {
+  if (h->killed)
+    warnx("hook `%s` timed out after %d sec", h->cmd, HOOK_TIMEOUT);
+  else if (WIFEXITED(status) && WEXITSTATUS(status))
+    warnx("hook `%s` exited w/ %d", h->cmd, WEXITSTATUS(status));
+  else if (WIFSIGNALED(status))
+    warnx("hook `%s` was killed by signal %d", h->cmd, WTERMSIG(status));
+
+  if (h->pidfd != -1) {
+    dockapp_remove_input(h->pidfd);
+    close(h->pidfd);
+  }
+  dockapp_remove_input(h->timer);
+  close(h->timer);
+  h->pid = 0;
+}
+
+static
+void on_hook_exit(int fd, void *data) {
+  Hook *h = data;
+  siginfo_t info = { .si_pid = 0 };
+  if (waitid(P_PIDFD, fd, &info, WEXITED | WNOHANG) == -1 || !info.si_pid)
+    return;
+
+  int status = info.si_code == CLD_EXITED ? W_EXITCODE(info.si_status, 0)
+    : info.si_status;		// the signal
+  hook_done(h, status);
+}
+
+static
+void on_timeout(int fd, void *data) {
+  Hook *h = data;
+  uint64_t expirations;
+  if (read(fd, &expirations, sizeof(expirations)) != sizeof(expirations))
+    return;
+  h->killed = true;
+  kill(-h->pid, SIGKILL);	// sh & everything it has started
+}
+
+void hook_reap() {
+  for (int i = 0; i < HOOK_MAX_RUNNING; ++i) {
+    Hook *h = &hooks[i];
+    int status;
+    if (h->pid && h->pidfd == -1 && waitpid(h->pid, &status, WNOHANG) > 0)
+      hook_done(h, status);
+  }
+}
+
+int hook_running() {
+  int n = 0;
+  for (int i = 0; i < HOOK_MAX_RUNNING; ++i) if (hooks[i].pid) n++;
+  return n;
+}
+
+bool hook_run(const char *template, int capacity) {
+  Hook *h = NULL;
+  char cmd[sizeof(h->cmd)];
+  if (!expand(cmd, sizeof(cmd), template, capacity)) {
+    warnx("hook `%s` is too long", template);
+    return false;
+  }
+
+  for (int i = 0; i < HOOK_MAX_RUNNING; ++i) {
+    if (!hooks[i].pid) {
+      if (!h) h = &hooks[i];
+    } else if (strcmp(hooks[i].cmd, cmd) == 0) {
+      return false;		// the previous alarm is still being handled
+    }
+  }
+  if (!h) {
+    warnx("too many hooks are running, skipping `%s`", cmd);
+    return false;
+  }
+
+  // the event loop blocks the signals it watches; the child
+  // shouldn't inherit that & gets its own process group for the kill
+  posix_spawnattr_t attr;
+  posix_spawnattr_init(&attr);
+  sigset_t none;
+  sigemptyset(&none);
+  posix_spawnattr_setsigmask(&attr, &none);
+  posix_spawnattr_setpgroup(&attr, 0);
+  posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK
+			   | POSIX_SPAWN_SETPGROUP);
+
+  char *argv[] = { "sh", "-c", cmd, NULL };
+  pid_t pid;
+  // glibc spawns w/ CLONE_VFORK: the X client's memory isn't copied
+  int r = posix_spawn(&pid, "/bin/sh", NULL, &attr, argv, environ);
+  posix_spawnattr_destroy(&attr);
+  if (r != 0) {
+    errno = r;
+    warn("failed to run `%s`", cmd);
+    return false;
+  }
+
+  h->pid = pid;
+  h->killed = false;
+  strcpy(h->cmd, cmd);
+
+#ifdef SYS_pidfd_open
+  h->pidfd = syscall(SYS_pidfd_open, pid, 0);
+#else
+  h->pidfd = -1;
+#endif
+  if (h->pidfd != -1 && !dockapp_add_input(h->pidfd, on_hook_exit, h)) {
+    close(h->pidfd);
+    h->pidfd = -1;		// reaped on SIGCHLD then
+  }
+
+  struct itimerspec timeout = { .it_value = { HOOK_TIMEOUT, 0 } };
+  h->timer = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+  if (h->timer == -1 || timerfd_settime(h->timer, 0, &timeout, NULL) == -1
+      || !dockapp_add_input(h->timer, on_timeout, h))
+    warn("no timeout for `%s`", cmd);
+  return true;
+}
@@ -0,0 +1,20 @@
+#ifndef HOOK_H
+#define HOOK_H
+
+#include <stdbool.h>
+
+// external commands for the alarms; they are spawned w/o forking
+// the X client & watched by the dockapp event loop
+#define HOOK_MAX_RUNNING 4
+#define HOOK_TIMEOUT 30		// sec, then the process group is killed
+
+// run `sh -c template` where %s is replaced by the capacity & %% by
+// %; return false if it wasn't started: too many hooks are running,
+// the same command is still running or the spawn failed
+bool hook_run(const char*, int);
+// reap the finished hooks; only needed on SIGCHLD if the kernel
+// lacks pidfds
+void hook_reap();
+int hook_running();
+
+#endif
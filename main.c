@@ -39,6 +39,9 @@ const char *argp_program_version = "0.0.2";
 #include <string.h>
 #include <signal.h>
 #include <sys/stat.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <stdatomic.h>
 #include <err.h>
 #include <argp.h>
 #include "dockapp.h"
@@ -46,31 +49,123 @@ const char *argp_program_version = "0.0.2";
 #include "backlight_off.xpm"
 #include "parts.xpm"
 #include "battery.h"
+#include "netlink.h"
+#include "supply.h"
+#include "sampler.h"
+#include "estimator.h"
+#include "offscreen.h"
+#include "stats.h"
+#include "hook.h"
+#include "shm.h"
+#include "server.h"
+#include "stream.h"
+#include "history.h"
 
 #define SIZE	    58
 #define WINDOWED_BG ". c #AEAAAE"
 
-Pixmap pixmap;
+Pixmap frames[2];		// a composed window per light, see Light
 Pixmap backdrop_on;
 Pixmap backdrop_off;
 Pixmap parts;
 Pixmap mask;
+Pixmap atlas;			// every field prerendered, see atlas_build()
+
+typedef struct Palette {
+  Pixmap backdrop_on;
+  Pixmap mask;
+  Pixmap parts;
+  Pixmap atlas;
+} Palette;
+
+static Palette palettes[2];	// on ac, on battery
 static unsigned switch_authorized = True;
+static BatterySession session;
+static Bool in_alarm_mode = False;
+static bool battery_is_pinned = false; // by -B
+static int uevents = -1;		// a netlink socket
+static atomic_bool reload_requested = false;
+static unsigned long wakeups = 0;	// timer ticks
+static uint64_t kicked = 0;		// when the last tick asked for a sample
+static time_t started;
+static Estimator estimator;	// touched only by the sampler thread
+static ShmSegment *shm;		// w/ --publish-shm
 
 typedef enum { LIGHTOFF, LIGHTON } Light;
 
+static Pixmap visible;		// the frame on the window
+static Light pre_backlight;	// before the alarm mode
+static int blink_fd = -1;	// a timerfd, armed in the alarm mode
+#define BLINK_INTERVAL 1	// sec
+
+/* what a frame shows; only the fields that differ are redrawn */
+typedef struct Frame {
+  bool valid;
+  int hours;			// 0-99
+  int minutes;
+  int pc;			// 0-100
+  bool is_charging;
+  bool is_ac_power;
+  int bars;			// 0-16
+} Frame;
+
+static Frame shown[2];		// per light
+
+/* the sparkline mode (button 2): the capacity of the last GRAPH_W
+   history samples, a column each, the newest on the right; a new
+   sample scrolls the graph by a column instead of redrawing it */
+#define GRAPH_X 6
+#define GRAPH_Y 6
+#define GRAPH_W 48		// ~4h of samples
+#define GRAPH_H 47
+
+static bool graph_mode = false;
+static Pixmap graphs[2];	// per light, created on the 1st use
+static Pixmap graph_bgs[2];	// the empty lcds
+static Pixmap pen;		// a black column
+static struct {
+  bool valid;
+  uint64_t drawn;		// history_count() at the last draw
+} graph_shown[2];
+
+enum { F_HOURS, F_MINUTES, F_PC, F_STATUS, F_BARS }; // the fields of a frame
+
+typedef struct Threshold {
+  int level;			// %
+  char *cmd;
+  bool fired;
+  time_t last;
+} Threshold;
+
+#define MAX_THRESHOLDS 8
+
 typedef struct Conf {
   char *display;
   Light backlight;
   char *light_color;		// #rgb
   char *light_color_bat;	// #rgb
   int update_interval;		// sec
+  int fallback_interval;	// sec, w/ kernel notifications
+  int adaptive;
+  bool smooth;			// the estimator for the time remaining
   int alarm_level;		// %
   char *cmd_notify;
+  Threshold thresholds[MAX_THRESHOLDS]; // -n w/ -a comes 1st
+  int nthresholds;
   int battery;
   int verbose;
   char *debug_uevent;		// a file name
   int debug_ac_power;
+  char *stats_file;
+  char *render_to;		// a .ppm file name
+  int render_bench;		// frames
+  const char *publish_shm;	// a shm segment name
+  const char *socket;		// a path
+  bool stream;			// w/o X
+  StreamFormat stream_format;
+  const char *stream_file;	// stdout if NULL
+  const char *history;		// a file, "off" or NULL for the default
+  bool uring;			// read sysfs w/ io_uring
 } Conf;
 
 Conf conf = {
@@ -79,48 +174,108 @@ Conf conf = {
   .light_color = "#6ec63b",
   .light_color_bat = NULL,
   .update_interval = 1,
+  .fallback_interval = 30,
+  .adaptive = 0,
+  .smooth = true,
   .alarm_level = 20,
   .cmd_notify = NULL,
+  .nthresholds = 0,
   .battery = -1,
   .verbose = 0,
   .debug_uevent = NULL,
-  .debug_ac_power = -1
+  .debug_ac_power = -1,
+  .stats_file = NULL,
+  .render_to = NULL,
+  .render_bench = 0,
+  .publish_shm = NULL,
+  .socket = NULL,
+  .stream = false,
+  .stream_format = STREAM_JSON,
+  .stream_file = NULL,
+  .history = NULL,
+  .uring = false
 };
 
 /* prototypes */
-static bool gui_update(Battery*, bool);
+static void gui_update(Battery*);
 static void switch_light(Battery*);
-static void draw_timedigit(Battery);
-static void draw_pcdigit(Battery);
-static void draw_statusdigit(Battery);
-static void draw_pcgraph(Battery);
+static void atlas_build(Palette*);
+static void draw_field(Pixmap, int, int, Light);
+static void frames_create(void);
+static void graphs_create(void);
+static bool frame_update(Light, Battery);
+static void draw_all_the_digits(Battery);
+static void frame_make(Frame*, Battery);
 static void cl_parse(int, char **);
 static void battery_set_current();
 static void bt_update(Battery*);
 static void backlight_setup(Battery*);
+static bool on_uevent(int, Battery*);
+static void on_sample(int, void*);
+static void on_blink(int, void*);
+static void blink_arm(bool);
+static void on_tick(void*);
+static void on_event(XEvent*, void*);
+static void on_signal(int, void*);
+static void schedule(const Battery*);
+static void headless(Battery*);
+static void gui_open(int, char**, Battery*);
 
 
 
 int main(int argc, char **argv) {
-  XEvent   event;
-  struct   sigaction sa;
-
-  sa.sa_handler = SIG_IGN;
-#ifdef SA_NOCLDWAIT
-  sa.sa_flags = SA_NOCLDWAIT;
-#else
-  sa.sa_flags = 0;
-#endif
-  sigemptyset(&sa.sa_mask);
-  sigaction(SIGCHLD, &sa, NULL);
-
   cl_parse(argc, argv);
 
   /* Initialize Application */
+  if (conf.publish_shm && !(shm = shm_create(conf.publish_shm)))
+    err(1, "%s", conf.publish_shm);
   battery_set_current();
+  battery_use_uring(conf.uring);
+  battery_session_open(&session, conf.battery);
+  estimator_init(&estimator, 0.1);
   Battery bt_current;
   bt_update(&bt_current);
+  if (conf.render_to || conf.render_bench) headless(&bt_current);
+
+  if (conf.stream) {
+    if (!stream_open(conf.stream_file, conf.stream_format))
+      err(1, "%s", conf.stream_file);
+    if (!stream_write(&bt_current)) err(1, "stream");
+  } else
+    gui_open(argc, argv, &bt_current);
+
+  /* Power supply change notifications */
+  if (!conf.debug_uevent && conf.fallback_interval) uevents = netlink_open();
+
+  /* All the sysfs reads happen in another thread */
+  if (!sampler_start(&bt_current, bt_update, uevents, on_uevent))
+    err(1, "failed to start the sampler");
+  dockapp_add_input(sampler_fd(), on_sample, &bt_current);
+
+  /* Local clients */
+  if (conf.socket) {
+    if (!server_open(conf.socket)) err(1, "%s", conf.socket);
+    server_publish(&bt_current);
+  }
+
+  if (!dockapp_add_signal(SIGTERM, on_signal, NULL)
+      || !dockapp_add_signal(SIGINT, on_signal, NULL)
+      || !dockapp_add_signal(SIGHUP, on_signal, NULL)
+      || !dockapp_add_signal(SIGCHLD, on_signal, NULL)
+      || !dockapp_add_signal(SIGUSR1, on_signal, NULL))
+    err(1, "failed to watch the signals");
+
+  /* Main loop */
+  started = time(NULL);
+  schedule(&bt_current);
+  dockapp_run(on_event, &bt_current);
+
+  return 0;
+}
 
+/* the window, its images & the blink timer */
+static
+void gui_open(int argc, char **argv, Battery *bt_current) {
   dockapp_open_window(conf.display, PACKAGE, SIZE, SIZE, argc, argv);
   dockapp_set_eventmask(ButtonPressMask);
 
@@ -128,246 +283,498 @@ int main(int argc, char **argv) {
   if (dockapp_iswindowed)
     backlight_on_xpm[1] = backlight_off_xpm[1] = WINDOWED_BG;
 
-  backlight_setup(&bt_current);
+  // the atlases are drawn over it
   if (!dockapp_xpm2pixmap(backlight_off_xpm, &backdrop_off, NULL, NULL, 0))
     err(1, "error initializing bg image");
+  backlight_setup(bt_current);
 
   /* shape window */
   if (!dockapp_iswindowed) dockapp_setshape(mask, 0, 0);
-  /* pixmap : draw area */
-  pixmap = dockapp_XCreatePixmap(SIZE, SIZE);
+  /* the frames : draw areas */
+  frames_create();
+  frame_update(conf.backlight, *bt_current);
+  visible = frames[conf.backlight];
+  dockapp_set_background(visible);
+  dockapp_show();
 
-  /* Initialize pixmap */
-  if (conf.backlight == LIGHTON)
-    dockapp_copyarea(backdrop_on, pixmap, 0, 0, SIZE, SIZE, 0, 0);
-  else
-    dockapp_copyarea(backdrop_off, pixmap, 0, 0, SIZE, SIZE, 0, 0);
+  /* The samples for the graph mode */
+  const char *history = conf.history ? conf.history : history_default_path();
+  if (history && strcmp(history, "off") && !history_open(history))
+    warn("%s", history);
 
-  dockapp_set_background(pixmap);
-  dockapp_show();
+  /* The alarm blinks on its own clock, disarmed till then */
+  blink_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+  if (blink_fd == -1 || !dockapp_add_input(blink_fd, on_blink, bt_current))
+    err(1, "failed to create the blink timer");
+}
 
-  /* Main loop */
-  bool prev_on_ac = false;
-  while (1) {
-    if (dockapp_nextevent_or_timeout(&event, conf.update_interval * 1000)) {
-      /* Next Event */
-      switch (event.type) {
-      case ButtonPress:
-	switch (event.xbutton.button) {
-	case 1: switch_light(&bt_current); break;
-	case 3: switch_authorized = !switch_authorized; break;
-	}
-	break;
-      default: break;
-      }
-    } else {
-      /* Time Out */
-      prev_on_ac = gui_update(&bt_current, prev_on_ac);
-    }
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
+
+/* wake up only when the display may change: the next flip of the
+   minute digit or of the percentage, whichever comes 1st; back off
+   while the readings are stable & hurry near the alarm level */
+static
+int adaptive_interval(const Battery *bt) {
+  static Battery prev;
+  static int stable = 0;
+  int min = conf.update_interval;
+  int max = MAX(conf.fallback_interval, min);
+
+  if (!bt->is_ac_power && bt->capacity <= conf.alarm_level + 2) return min;
+
+  bool same = prev.capacity == bt->capacity
+    && prev.is_ac_power == bt->is_ac_power
+    && prev.is_charging == bt->is_charging;
+  stable = same ? MIN(MAX(stable, min) * 2, max) : min;
+  prev = *bt;
+
+  int next = stable;
+  if (bt->seconds_remaining > 0) {
+    next = MIN(next, bt->seconds_remaining % 60 + 1);
+
+    // 1% of the charge takes roughly this long at the current rate
+    int percents = bt->is_charging ? 100 - bt->capacity : bt->capacity;
+    if (percents > 0) next = MIN(next, bt->seconds_remaining / percents);
+  }
+  return MAX(next, min);
+}
+
+/* (re)arm the timer if the interval has changed */
+static
+void schedule(const Battery *bt) {
+  static int armed = 0;
+
+  // w/ the notifications the timer only catches the slow drift of
+  // the power/energy values
+  int interval = conf.update_interval;
+  if (conf.adaptive)
+    interval = adaptive_interval(bt);
+  else if (uevents != -1 && conf.fallback_interval > interval)
+    interval = conf.fallback_interval;
+
+  if (interval == armed) return;
+  if (!dockapp_set_timer(interval * 1000, on_tick, NULL))
+    err(1, "failed to set the timer");
+  armed = interval;
+
+  if (conf.verbose) {
+    double hours = difftime(time(NULL), started) / 3600;
+    fprintf(stderr, "schedule(): every %d sec, %.0f wakeups/h"
+	    " (%d w/ -u %d)\n", interval, hours > 0 ? wakeups / hours : 0,
+	    3600 / conf.update_interval, conf.update_interval);
   }
+}
 
-  return 0;
+static
+void on_tick(void *data) {
+  wakeups++;
+  stats_count(COUNTER_TICKS, 1);
+  if (!kicked) kicked = stats_now();
+  sampler_kick();
 }
 
-
+static
+void on_event(XEvent *event, void *data) {
+  Battery *bt_current = data;
+
+  switch (event->type) {
+  case ButtonPress:
+    switch (event->xbutton.button) {
+    case 1: switch_light(bt_current); break;
+    case 2:
+      if (!graphs[LIGHTOFF]) graphs_create();
+      graph_mode = !graph_mode;
+      draw_all_the_digits(*bt_current);
+      break;
+    case 3: switch_authorized = !switch_authorized; break;
+    }
+    break;
+  default: break;
+  }
+}
 
 static
-void backlight_setup(Battery *infos) {
-  char *color = conf.light_color;
-  if (!infos->is_ac_power && conf.light_color_bat)
-    color = conf.light_color_bat;
+void on_signal(int sig, void *data) {
+  switch (sig) {
+  case SIGTERM:
+  case SIGINT:
+    if (conf.stats_file) stats_dump_to(conf.stats_file);
+    if (shm) shm_remove(conf.publish_shm);
+    server_close();
+    if (display) XCloseDisplay(display);
+    exit(0);
+  case SIGHUP:
+    // rescan the power supplies & repaint everything
+    atomic_store(&reload_requested, true);
+    shown[LIGHTOFF].valid = shown[LIGHTON].valid = false;
+    graph_shown[LIGHTOFF].valid = graph_shown[LIGHTON].valid = false;
+    sampler_kick();
+    break;
+  case SIGCHLD:
+    hook_reap();
+    break;
+  case SIGUSR1:
+    if (conf.stats_file) {
+      if (!stats_dump_to(conf.stats_file)) warn("%s", conf.stats_file);
+    } else
+      stats_dump(stderr);
+    break;
+  }
+}
+
 
+
+/* the backlit images are built once per color & then just swapped */
+static
+void palette_build(Palette *p, char *color) {
   XpmColorSymbol colors[2] = { {"Back0", NULL, 0}, {"Back1", NULL, 0} };
   colors[0].pixel = dockapp_getcolor(color);
   colors[1].pixel = dockapp_blendedcolor(color, -24, -24, -24, 1.0);
   int ncolor = 2;
 
-  // free previous pixmap values
-  if (backdrop_on) XFreePixmap(display, backdrop_on);
-  if (mask) XFreePixmap(display, mask);
-
-  if (!dockapp_xpm2pixmap(backlight_on_xpm, &backdrop_on, &mask, colors, ncolor))
+  if (!dockapp_xpm2pixmap(backlight_on_xpm, &p->backdrop_on, &p->mask,
+			  colors, ncolor))
     err(1, "error initializing backlit bg image");
-  if (!dockapp_xpm2pixmap(parts_xpm, &parts, NULL, colors, ncolor))
+  if (!dockapp_xpm2pixmap(parts_xpm, &p->parts, NULL, colors, ncolor))
     err(1, "error initializing parts image");
+  atlas_build(p);
 }
 
 static
-void draw_all_the_digits(Battery bt) {
-  draw_timedigit(bt);
-  draw_pcdigit(bt);
-  draw_statusdigit(bt);
-  draw_pcgraph(bt);
-
-  dockapp_copy2window(pixmap); // show
-}
-
-static int
-my_system (char *cmd) {
-  if (!cmd) return -1;
-  int pid;
-  extern char **environ;
-
-  if (cmd == 0) return 1;
-  pid = fork();
-  if (pid == -1) return -1;
-  if (pid == 0) {
-    pid = fork();
-    if (pid == 0) {
-      char *argv[4];
-      argv[0] = "sh";
-      argv[1] = "-c";
-      argv[2] = cmd;
-      argv[3] = 0;
-      execve("/bin/sh", argv, environ);
-      exit(0);
-    }
-    exit(0);
+void backlight_setup(Battery *infos) {
+  char *color = conf.light_color;
+  Palette *p = &palettes[0];
+  if (!infos->is_ac_power && conf.light_color_bat) {
+    color = conf.light_color_bat;
+    p = &palettes[1];
   }
-  return 0;
+
+  if (!p->parts) palette_build(p, color);
+  if (parts == p->parts) return;
+
+  backdrop_on = p->backdrop_on;
+  parts = p->parts;
+  atlas = p->atlas;
+  if (!mask) mask = p->mask;	// the same shape for any color
+  shown[LIGHTOFF].valid = shown[LIGHTON].valid = false; // another palette
+  graph_shown[LIGHTOFF].valid = graph_shown[LIGHTON].valid = false;
 }
 
-static void
-alert(char *template, Battery bt) {
-  if (!template) return;
+static
+void frames_create() {
+  for (Light light = LIGHTOFF; light <= LIGHTON; light++)
+    frames[light] = dockapp_XCreatePixmap(SIZE, SIZE);
+}
+
+/* bring the frame of a light up to the battery state; false if it
+   already shows it */
+static
+bool frame_update(Light light, Battery bt) {
+  Frame frame;
+  Frame *prev = &shown[light];
+
+  frame_make(&frame, bt);
+  if (!prev->valid) {
+    Pixmap bg = light == LIGHTON ? backdrop_on : backdrop_off;
+    dockapp_copyarea(bg, frames[light], 0, 0, SIZE, SIZE, 0, 0);
+  }
 
-  char percent[3];
-  snprintf(percent, sizeof(percent), "%d", bt.capacity); // itoa
+#define CHANGED(field) (!prev->valid || prev->field != frame.field)
+  bool changed = false;
+  if (CHANGED(hours))
+    draw_field(frames[light], F_HOURS, frame.hours, light), changed = true;
+  if (CHANGED(minutes))
+    draw_field(frames[light], F_MINUTES, frame.minutes, light), changed = true;
+  if (CHANGED(pc))
+    draw_field(frames[light], F_PC, frame.pc, light), changed = true;
+  if (CHANGED(is_charging) || CHANGED(is_ac_power))
+    draw_field(frames[light], F_STATUS,
+	       frame.is_charging * 2 + frame.is_ac_power, light), changed = true;
+  if (CHANGED(bars))
+    draw_field(frames[light], F_BARS, frame.bars, light), changed = true;
+#undef CHANGED
+  *prev = frame;
+  return changed;
+}
 
-  char *cmd;
-  asprintf(&cmd, template, percent);
-  my_system(cmd);
-  free(cmd);
+static
+void graphs_create() {
+  for (Light light = LIGHTOFF; light <= LIGHTON; light++) {
+    graphs[light] = dockapp_XCreatePixmap(SIZE, SIZE);
+    graph_bgs[light] = dockapp_XCreatePixmap(SIZE, SIZE);
+  }
+  // out of the 1x7 stem of a digit
+  pen = dockapp_XCreatePixmap(1, GRAPH_H);
+  for (int y = 0; y < GRAPH_H; y += 7)
+    dockapp_copyarea(parts, pen, 98, 2, 1, MIN(7, GRAPH_H - y), 0, y);
+}
+
+static
+void graph_column(Light light, int col, const HistorySample *s) {
+  int h = s && s->capacity > 0 ? MIN(s->capacity, 100) * GRAPH_H / 100 : 0;
+  if (h) dockapp_copyarea(pen, graphs[light], 0, 0, 1, h,
+			  GRAPH_X + col, GRAPH_Y + GRAPH_H - h);
+}
+
+/* bring the graph of a light up to the history; false if it already
+   shows it */
+static
+bool graph_update(Light light) {
+  uint64_t count = history_count();
+  uint64_t n = count - graph_shown[light].drawn; // new samples
+  Pixmap g = graphs[light], bg = graph_bgs[light];
+
+  if (graph_shown[light].valid && !n) return false;
+
+  if (!graph_shown[light].valid) {
+    // the backdrop w/o the digit & bar outlines: rows 27-32 are clean
+    Pixmap backdrop = light == LIGHTON ? backdrop_on : backdrop_off;
+    dockapp_copyarea(backdrop, bg, 0, 0, SIZE, SIZE, 0, 0);
+    for (int y = 5; y < 54; y += 6)
+      dockapp_copyarea(backdrop, bg, 4, 27, 52, MIN(6, 54 - y), 4, y);
+  }
+
+  if (!graph_shown[light].valid || n >= GRAPH_W) {
+    dockapp_copyarea(bg, g, 0, 0, SIZE, SIZE, 0, 0);
+    n = MIN(count, GRAPH_W);
+  } else {
+    dockapp_copyarea(g, g, GRAPH_X + n, GRAPH_Y, GRAPH_W - n, GRAPH_H,
+		     GRAPH_X, GRAPH_Y);
+    dockapp_copyarea(bg, g, GRAPH_X + GRAPH_W - n, GRAPH_Y, n, GRAPH_H,
+		     GRAPH_X + GRAPH_W - n, GRAPH_Y);
+  }
+  for (uint64_t i = count - n; i < count; i++)
+    graph_column(light, GRAPH_W - (count - i), history_get(i));
+
+  graph_shown[light].valid = true;
+  graph_shown[light].drawn = count;
+  return true;
+}
+
+/* another light or mode is just another window background: no
+   redraw; the windowed & the broken wm modes paint the window
+   itself, as does the offscreen backend */
+static
+void frame_show(Pixmap frame) {
+  if (frame != visible && display && !dockapp_iswindowed
+      && !dockapp_isbrokenwm)
+    dockapp_set_background(frame);
+  else
+    dockapp_copy2window(frame);
+  visible = frame;
+}
+
+static
+void draw_all_the_digits(Battery bt) {
+  unsigned long requests = dockapp_nrequests;
+  uint64_t start = stats_now();
+  Light light = conf.backlight;
+
+  bool changed = graph_mode ? graph_update(light) : frame_update(light, bt);
+  Pixmap frame = graph_mode ? graphs[light] : frames[light];
+  if (changed || frame != visible) frame_show(frame);
+  stats_stage(STAGE_DRAW, start);
+  stats_count(COUNTER_X_REQUESTS, dockapp_nrequests - requests);
+  if (conf.verbose > 1)
+    fprintf(stderr, "frame: %lu X requests\n", dockapp_nrequests - requests);
 }
 
-/* called by timer */
+/* every threshold fires once when the capacity drops below it on
+   battery & is rearmed by ac power or a higher capacity; an ac
+   adapter that flaps can't fire it more often than this */
+#define ALARM_MIN_INTERVAL 60	// sec
+
 static
-bool gui_update(Battery *bt_current, bool prev_on_ac) {
-  static Light pre_backlight;
-  static Bool in_alarm_mode = False;
+void alarms_check(const Battery *bt) {
+  time_t now = time(NULL);
+  for (int i = 0; i < conf.nthresholds; ++i) {
+    Threshold *t = &conf.thresholds[i];
+    if (bt->is_ac_power || bt->capacity >= t->level) {
+      t->fired = false;
+      continue;
+    }
+    if (t->fired || (t->last && now - t->last < ALARM_MIN_INTERVAL)) continue;
 
-  bt_update(bt_current);
+    t->fired = true;
+    t->last = now;
+    if (hook_run(t->cmd, bt->capacity) && conf.verbose)
+      fprintf(stderr, "alarm at %d%%: %s\n", t->level, t->cmd);
+  }
+}
 
-  if (prev_on_ac) {
+/* called by timer or on a power supply change */
+static
+void gui_update(Battery *bt_current) {
+  static bool prev_on_ac = false;
+
+  alarms_check(bt_current);
+
+  bool was_on_ac = prev_on_ac;
+  prev_on_ac = bt_current->is_ac_power;
+  if (was_on_ac) {
     if (!bt_current->is_ac_power) backlight_setup(bt_current);
   } else {                      /* was on battery */
     if (bt_current->is_ac_power) backlight_setup(bt_current);
   }
 
-  /* alarm mode */
+  /* alarm mode: the blinking is up to on_blink() */
   if (bt_current->capacity < conf.alarm_level && !bt_current->is_ac_power) {
     if (!in_alarm_mode) {
       in_alarm_mode = True;
       pre_backlight = conf.backlight;
-      alert(conf.cmd_notify, *bt_current);
-    }
-    if (switch_authorized ||
-	(!switch_authorized && conf.backlight != pre_backlight)) {
-      switch_light(bt_current);
-      return bt_current->is_ac_power;
-    }
-  } else {
-    if (in_alarm_mode) {
-      in_alarm_mode = False;
-      if (conf.backlight != pre_backlight) {
-	switch_light(bt_current);
-	return bt_current->is_ac_power;
-      }
+      blink_arm(true);
     }
+  } else if (in_alarm_mode) {
+    in_alarm_mode = False;
+    blink_arm(false);
+    conf.backlight = pre_backlight;
   }
 
-  /* all clear */
-  if (conf.backlight == LIGHTON)
-    dockapp_copyarea(backdrop_on, pixmap, 0, 0, SIZE, SIZE, 0, 0);
-  else
-    dockapp_copyarea(backdrop_off, pixmap, 0, 0, SIZE, SIZE, 0, 0);
-
   draw_all_the_digits(*bt_current);
+}
+
+static
+void blink_arm(bool on) {
+  struct itimerspec spec = { {0} };
+  if (on) spec.it_interval.tv_sec = spec.it_value.tv_sec = BLINK_INTERVAL;
+  if (timerfd_settime(blink_fd, 0, &spec, NULL) == -1)
+    err(1, "failed to set the blink timer");
+}
 
-  return bt_current->is_ac_power;
+/* swaps the prebuilt frames, no matter how often the battery is read */
+static
+void on_blink(int fd, void *data) {
+  uint64_t expirations;
+  if (read(fd, &expirations, sizeof expirations) == -1) return;
+
+  if (in_alarm_mode
+      && (switch_authorized || conf.backlight != pre_backlight))
+    switch_light(data);
 }
 
 /* called when mouse button pressed */
 static
 void switch_light(Battery *bt_current) {
-  if (conf.backlight == LIGHTOFF) {
+  if (conf.backlight == LIGHTOFF)
     conf.backlight = LIGHTON;
-    dockapp_copyarea(backdrop_on, pixmap, 0, 0, SIZE, SIZE, 0, 0);
-  } else {
+  else
     conf.backlight = LIGHTOFF;
-    dockapp_copyarea(backdrop_off, pixmap, 0, 0, SIZE, SIZE, 0, 0);
-  }
 
   draw_all_the_digits(*bt_current);
 }
 
-static void draw_timedigit(Battery infos) {
-  int y = 0;
-  int hour_left, min_left;
+static void frame_make(Frame *f, Battery infos) {
+  f->valid = true;
 
-  if (conf.backlight == LIGHTON) y = 20;
+  f->hours = infos.seconds_remaining / 3600;
+  if (f->hours > 99) f->hours = 99;
+  f->minutes = infos.seconds_remaining / 60 % 60;
 
-  hour_left = infos.seconds_remaining / 3600;
-  min_left = infos.seconds_remaining / 60 % 60;
-  dockapp_copyarea(parts, pixmap, (hour_left / 10) * 10, y, 10, 20,  5, 7);
-  dockapp_copyarea(parts, pixmap, (hour_left % 10) * 10, y, 10, 20, 17, 7);
-  dockapp_copyarea(parts, pixmap, (min_left / 10)  * 10, y, 10, 20, 32, 7);
-  dockapp_copyarea(parts, pixmap, (min_left % 10)  * 10, y, 10, 20, 44, 7);
-}
+  f->pc = infos.capacity;
+  if (f->pc < 0) f->pc = 0;
+  if (f->pc > 100) f->pc = 100;
 
-static void draw_pcdigit(Battery infos) {
-  int v100, v10, v1;
-  int xd = 0;
-  int num = infos.capacity;
+  f->is_charging = infos.is_charging;
+  f->is_ac_power = infos.is_ac_power;
 
-  if (num < 0)  num = 0;
+  f->bars = f->pc / 6.25;
+}
 
-  v100 = num / 100;
-  v10  = (num - v100 * 100) / 10;
-  v1   = (num - v100 * 100 - v10 * 10);
+/* every rendering of a field lives in a strip of the atlas, so a
+   changed field costs 1 copy instead of 1 per glyph; the strips of
+   the 2 lights are stacked */
+typedef struct Field {
+  int x, y, w, h;		// in the window
+  int band;			// the y of the strips in the atlas
+} Field;
+
+static const Field fields[] = {
+  [F_HOURS]	= {  5,  7, 22, 20,  0 },	// 00-99
+  [F_MINUTES]	= { 32,  7, 22, 20, 20 },	// 00-59
+  [F_PC]	= {  5, 45, 17,  9, 40 },	// 0-100
+  [F_STATUS]	= { 34, 45, 19,  9, 49 },	// charging * 2 + ac
+  [F_BARS]	= {  6, 33, 47,  9, 58 },	// 0-16
+};
 
-  if (conf.backlight == LIGHTON) xd = 50;
+#define ATLAS_W     (100 * 22)	// the widest band
+#define ATLAS_LIGHT 67		// the height of 1 light
 
-  /* draw digit */
-  dockapp_copyarea(parts, pixmap, v1 * 5 + xd, 40, 5, 9, 17, 45);
-  if (v10 != 0)
-    dockapp_copyarea(parts, pixmap, v10 * 5 + xd, 40, 5, 9, 11, 45);
-  if (v100 == 1) {
-    dockapp_copyarea(parts, pixmap, 5 + xd, 40, 5, 9, 5, 45);
-    dockapp_copyarea(parts, pixmap, 0 + xd, 40, 5, 9, 11, 45);
-  }
+static
+void draw_field(Pixmap dest, int field, int i, Light light) {
+  const Field *f = &fields[field];
+  dockapp_copyarea(atlas, dest, i * f->w, light * ATLAS_LIGHT + f->band,
+		   f->w, f->h, f->x, f->y);
 }
 
-static void draw_statusdigit(Battery infos) {
-  int xd = 0;
-  int y = 31;
-
-  if (conf.backlight == LIGHTON) {
-    y = 40;
-    xd = 50;
+/* the glyphs of a field over a clean backdrop, at the window coords */
+static
+void paint_field(Pixmap dest, int field, int i, Light light) {
+  static const int digit_x[] = { 5, 17, 32, 44 };
+  int on = light == LIGHTON;
+
+  switch (field) {
+  case F_HOURS:
+  case F_MINUTES: {
+    const int *x = &digit_x[field == F_MINUTES ? 2 : 0];
+    dockapp_copyarea(parts, dest, i / 10 * 10, on * 20, 10, 20, x[0], 7);
+    dockapp_copyarea(parts, dest, i % 10 * 10, on * 20, 10, 20, x[1], 7);
+    break;
+  }
+  case F_PC: {
+    int xd = on * 50;
+    if (i == 100) {
+      dockapp_copyarea(parts, dest, 5 + xd, 40, 5, 9, 5, 45);
+      dockapp_copyarea(parts, dest, 0 + xd, 40, 5, 9, 11, 45);
+    } else if (i >= 10)
+      dockapp_copyarea(parts, dest, i / 10 * 5 + xd, 40, 5, 9, 11, 45);
+    dockapp_copyarea(parts, dest, i % 10 * 5 + xd, 40, 5, 9, 17, 45);
+    break;
+  }
+  case F_STATUS: {
+    int xd = on * 50;
+    if (i / 2)			// charging
+      dockapp_copyarea(parts, dest, 100, on ? 40 : 31, 4, 9, 41, 45);
+    if (i % 2)			// ac
+      dockapp_copyarea(parts, dest, 0 + xd, 49, 5, 9, 34, 45);
+    else
+      dockapp_copyarea(parts, dest, 5 + xd, 49, 5, 9, 48, 45);
+    break;
+  }
+  case F_BARS:
+    for (int nb = 0; nb < i; nb++)
+      dockapp_copyarea(parts, dest, 100 + on * 2, 0, 2, 9, 6 + nb * 3, 33);
+    break;
   }
-
-  if (infos.is_charging)
-    dockapp_copyarea(parts, pixmap, 100, y, 4, 9, 41, 45);
-
-  if (infos.is_ac_power)
-    dockapp_copyarea(parts, pixmap, 0 + xd, 49, 5, 9, 34, 45);
-  else
-    dockapp_copyarea(parts, pixmap, 5 + xd, 49, 5, 9, 48, 45);
 }
 
-static void draw_pcgraph(Battery infos) {
-  int xd = 100;
-  int nb;
-  int num = infos.capacity / 6.25 ;
-
-  if (num < 0) num = 0;
-
-  if (conf.backlight == LIGHTON) xd = 102;
-
-  /* draw digit */
-  for (nb = 0 ; nb < num ; nb++)
-    dockapp_copyarea(parts, pixmap, xd, 0, 2, 9, 6 + nb * 3, 33);
+/* ~2300 copies once per palette, for ~1.2MB of server memory */
+static
+void atlas_build(Palette *p) {
+  static const int count[] = {
+    [F_HOURS] = 100, [F_MINUTES] = 60, [F_PC] = 101, [F_STATUS] = 4,
+    [F_BARS] = 17
+  };
+  static Pixmap scratch;	// shared by the palettes
+  Pixmap saved = parts;
+
+  if (!scratch) scratch = dockapp_XCreatePixmap(SIZE, SIZE);
+
+  parts = p->parts;
+  p->atlas = dockapp_XCreatePixmap(ATLAS_W, 2 * ATLAS_LIGHT);
+  for (Light light = LIGHTOFF; light <= LIGHTON; light++) {
+    Pixmap bg = light == LIGHTON ? p->backdrop_on : backdrop_off;
+    for (int field = F_HOURS; field <= F_BARS; field++) {
+      const Field *f = &fields[field];
+      for (int i = 0; i < count[field]; i++) {
+	dockapp_copyarea(bg, scratch, f->x, f->y, f->w, f->h, f->x, f->y);
+	paint_field(scratch, field, i, light);
+	dockapp_copyarea(scratch, p->atlas, f->x, f->y, f->w, f->h,
+			 i * f->w, light * ATLAS_LIGHT + f->band);
+      }
+    }
+  }
+  parts = saved;
 }
 
 static error_t
@@ -384,14 +791,37 @@ parse_opt(int key, char *arg, struct argp_state *state) {
     args->update_interval = atoi(arg);
     if (args->update_interval < 1) errx(1, "-u should be > 1");
     break;
+  case 'U':
+    args->fallback_interval = atoi(arg);
+    if (args->fallback_interval < 0) errx(1, "-U should be >= 0");
+    break;
   case 'a':
     args->alarm_level = atoi(arg);
     if (args->alarm_level < 1 || args->alarm_level > 99)
       errx(1, "-a valid range: [1-99]");
     break;
+  case 'A': args->adaptive = 1; break;
+  case 'E':
+    if (0 == strcmp(arg, "raw"))
+      args->smooth = false;
+    else if (0 == strcmp(arg, "smooth"))
+      args->smooth = true;
+    else
+      errx(1, "-E valid values: raw, smooth");
+    break;
   case 'w': dockapp_iswindowed = True; break;
   case 'W': dockapp_isbrokenwm = True; break;
   case 'n': args->cmd_notify = arg; break;
+  case 'N': {
+    if (args->nthresholds == MAX_THRESHOLDS - 1) errx(1, "too many -N");
+    Threshold *t = &args->thresholds[++args->nthresholds];
+    char *cmd;
+    t->level = strtol(arg, &cmd, 10);
+    if (*cmd != ':' || t->level < 1 || t->level > 100)
+      errx(1, "-N should be %%:cmd, e.g. 5:'systemctl hibernate'");
+    t->cmd = cmd + 1;
+    break;
+  }
   case 'p':
     bt_list = battery_list();
     if (bt_list) {
@@ -401,10 +831,35 @@ parse_opt(int key, char *arg, struct argp_state *state) {
     }
     errx(1, "no batteries detected");
     break;
-  case 'B': args->battery = atoi(arg); break;
+  case 'B':
+    args->battery = 0 == strcmp(arg, "all") ? BATTERY_ALL : atoi(arg);
+    break;
   case 'v': args->verbose++; break;
   case 300: args->debug_uevent = arg; break;
   case 301: args->debug_ac_power = atoi(arg); break;
+  case 'S': args->stats_file = arg; break;
+  case 302: args->render_to = arg; break;
+  case 303:
+    args->render_bench = atoi(arg);
+    if (args->render_bench < 1) errx(1, "--render-bench should be > 0");
+    break;
+  case 306:
+    args->stream = true;
+    if (!arg || 0 == strcmp(arg, "json"))
+      args->stream_format = STREAM_JSON;
+    else if (0 == strcmp(arg, "csv"))
+      args->stream_format = STREAM_CSV;
+    else
+      errx(1, "--stream should be json or csv");
+    break;
+  case 307: args->stream_file = arg; break;
+  case 308: args->history = arg; break;
+  case 309: args->uring = true; break;
+  case 305: args->socket = arg ? arg : server_default_path(); break;
+  case 304:
+    args->publish_shm = arg ? arg : shm_default_name();
+    if (args->publish_shm[0] != '/') errx(1, "--publish-shm should start w/ /");
+    break;
   default:
     return ARGP_ERR_UNKNOWN;
   }
@@ -419,60 +874,223 @@ cl_parse(int argc, char **argv) {
     {"light-color",     'l', "#rgb", 0, "A default backlight color" },
     {"light-color-bat", 'L', "#rgb", 0, "A backlight color when AC is off" },
     {"update-interval", 'u', "num",  0, "Seconds between the updates" },
+    {"fallback-interval", 'U', "num", 0, "Seconds between the updates when the kernel reports the changes (0 turns the reports off)" },
     {"alarm-level",     'a', "%",    0, "A low battery level that raises the alarm" },
+    {"adaptive",        'A', 0,      0, "Wake up only when the display may change" },
+    {"estimator",       'E', "mode", 0, "The time remaining: raw (the current power) or smooth (the trend of the latest samples, the default)" },
     {"windowed",        'w', 0,      0, "Run the app in the windowed mode" },
     {"broken-wm",       'W', 0,      0, "Activate the broken WM fix" },
     {"cmd-notify",      'n', "str",  0, "A command to launch when the alarm is on" },
+    {"cmd-at",          'N', "%:str", 0, "A command to launch when the level drops below % (may be repeated)" },
+    {"stats-file",      'S', "file", 0, "Where to dump the timings on SIGUSR1 (stderr by default) & on exit" },
+    {"stream",          306, "fmt",  OPTION_ARG_OPTIONAL, "Don't open a window, write a record on every change to stdout: json (JSON Lines, the default) or csv" },
+    {"stream-file",     307, "file", 0, "Append the --stream records to a file instead" },
+    {"history",         308, "file", 0, "Where to keep the samples for the graph ($XDG_STATE_HOME/wmvolt/history.bin by default) or off" },
+    {"socket",          305, "path", OPTION_ARG_OPTIONAL, "Answer GET & SUBSCRIBE requests on a unix socket ($XDG_RUNTIME_DIR/wmvolt.sock by default)" },
+    {"publish-shm",     304, "/name", OPTION_ARG_OPTIONAL, "Share every sample w/ other programs in a POSIX shm segment (/wmvolt-<uid> by default) for wmvolt-read" },
+    {"uring",           309, 0,      0, "Read all the power supplies w/ 1 io_uring syscall instead of 1 pread per file" },
     {"print-batteries", 'p', 0,      0, "Print all the available batteries" },
-    {"battery",         'B', "num",  0, "Explicitly select the battery" },
+    {"battery",         'B', "num",  0, "Explicitly select the battery (\"all\" sums up every battery)" },
     // debug
     {"verbose",         'v', 0,      0, "Increase the verbosity level" },
     {"debug-uevent",    300, "file", 0, "Use fake uevent data" },
     {"debug-ac",        301, "num",  0, "Use fake ac power data" },
+    {"render-to",       302, "file", 0, "Draw 1 frame into a .ppm file w/o X & exit" },
+    {"render-bench",    303, "num",  0, "Draw that many frames w/o X & print the speed" },
     { 0 }
   };
   struct argp argp = { options, parse_opt, NULL, NULL };
   argp_parse(&argp, argc, argv, 0, 0, &conf);
+
+  // -N's are in the slots from #1, #0 is for -n
+  if (conf.cmd_notify) {
+    conf.thresholds[0] = (Threshold){ conf.alarm_level, conf.cmd_notify };
+    conf.nthresholds++;
+  } else {
+    memmove(conf.thresholds, conf.thresholds + 1,
+	    conf.nthresholds * sizeof(Threshold));
+  }
 }
 
 static
-char *iso8601() {
-  char *buf = malloc(21);
+char *iso8601(char *buf, size_t size) {
   time_t now = time(NULL);
-  strftime(buf, 21, "%FT%TZ", gmtime(&now));
+  struct tm tm;
+  strftime(buf, size, "%FT%TZ", gmtime_r(&now, &tm));
   return buf;
 }
 
+static
+void bt_print(char *src, Battery *bt) {
+  char ts[21];
+  fprintf(stderr, "%s: %s: ", iso8601(ts, sizeof(ts)), src);
+  fprintf(stderr, "id=%d, ac=%d, charging=%d, %%=%d, sec=%d\n",
+	  bt->id, bt->is_ac_power, bt->is_charging, bt->capacity,
+	  bt->seconds_remaining);
+}
+
+// the current battery is gone: switch to another one unless it was
+// selected explicitly, or just show the ac status until a battery
+// is plugged in
+static
+void bt_reselect(Battery *bt) {
+  int first;
+  if (!battery_is_pinned && battery_ids(&first, 1)) {
+    if (conf.verbose && first != conf.battery)
+      fprintf(stderr, "battery #%d is gone, switching to #%d\n",
+	      conf.battery, first);
+    conf.battery = first;
+    battery_session_close(&session);
+    if (battery_session_open(&session, conf.battery)
+	&& battery_session_get(&session, bt)) return;
+  }
+
+  battery_init(bt);
+  bt->id = conf.battery;
+  bt->is_ac_power = battery_session_ac_power(&session) == 1;
+  bt->capacity = 0;
+  bt->seconds_remaining = 0;
+}
+
+// replace the instantaneous time remaining w/ the one derived from
+// the recent energy changes
+static
+void bt_estimate(Battery *bt) {
+  if (!conf.smooth) return;
+
+  static int id = -1;
+  if (bt->id != id) estimator_reset(&estimator); // another battery
+  id = bt->id;
+
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  estimator_add(&estimator, ts.tv_sec + ts.tv_nsec / 1e9, bt);
+  estimator_apply(&estimator, bt);
+}
+
 static
 void bt_update(Battery *bt_current) {
-  if (conf.verbose) {
-    char *ts = iso8601();
-    fprintf(stderr, "%s: bt_update(): ", ts);
-    free(ts);
+  if (atomic_exchange(&reload_requested, false) && !conf.debug_uevent) {
+    supply_rescan();
+    battery_session_close(&session);
+    battery_session_open(&session, conf.battery);
   }
 
   Battery bt;
-  bool r = conf.debug_uevent ? battery_get_from_file(conf.debug_uevent, &bt) : battery_get(conf.battery, &bt);
-  if (!r) err(1, "failed to get data for battery #%d", conf.battery);
+  if (conf.debug_uevent) {
+    if (!battery_get_from_file(conf.debug_uevent, &bt))
+      err(1, "failed to get data for battery #%d", conf.battery);
+  } else if (!battery_session_get(&session, &bt)) {
+    bt_reselect(&bt);
+  }
+  bt_estimate(&bt);
 
-  bt_current->is_ac_power = conf.debug_ac_power != -1 ? conf.debug_ac_power : bt.is_ac_power;
-  bt_current->is_charging = bt.is_charging;
-  bt_current->capacity = bt.capacity;
-  bt_current->seconds_remaining = bt.seconds_remaining;
+  *bt_current = bt;
+  if (conf.debug_ac_power != -1) bt_current->is_ac_power = conf.debug_ac_power;
 
-  if (conf.verbose) {
-    fprintf(stderr, "id=%d, ac=%d, charging=%d, %%=%d, sec=%d\n",
-	    bt.id, bt.is_ac_power, bt.is_charging, bt.capacity,
-	    bt.seconds_remaining);
+  if (conf.verbose) bt_print("bt_update()", &bt);
+  if (shm) shm_write(shm, bt_current);
+}
+
+/* called in the sampler thread when the kernel reports a power
+   supply change */
+static
+bool on_uevent(int fd, Battery *bt_current) {
+  static char msg[BUFSIZ];
+  bool changed = false, hotplug = false;
+
+  ssize_t len;
+  while ( (len = netlink_read(fd, msg, sizeof(msg))) != -1) {
+    if (!len) continue;
+    if (netlink_is_hotplug(msg, len))
+      hotplug = true;
+    else if (battery_session_event(&session, msg, len, bt_current))
+      changed = true;
   }
+
+  if (hotplug) {
+    supply_rescan();
+    bt_update(bt_current);
+    return true;
+  }
+
+  if (!changed) return false;
+  bt_estimate(bt_current);
+  // the same as in bt_update(), or the display flips between the two
+  if (conf.debug_ac_power != -1) bt_current->is_ac_power = conf.debug_ac_power;
+
+  if (conf.verbose) bt_print("on_uevent()", bt_current);
+  if (shm) shm_write(shm, bt_current);
+  return true;
+}
+
+/* called when the sampler has published a new snapshot */
+static
+void on_sample(int fd, void *data) {
+  Battery *bt_current = data;
+  sampler_get(bt_current);
+  server_publish(bt_current);
+  if (conf.stream) {
+    alarms_check(bt_current);
+    if (!stream_write(bt_current)) err(1, "stream");
+  } else {
+    history_add(bt_current);
+    gui_update(bt_current);
+  }
+  schedule(bt_current);		// the alarm mode may have changed
+
+  if (kicked) stats_stage(STAGE_TICK, kicked);
+  kicked = 0;
 }
 
 static
 void battery_set_current() {
-  if (conf.battery != -1) return;
+  if (conf.debug_uevent) return;
+  if (conf.battery != -1) {
+    battery_is_pinned = true;
+    return;
+  }
+
+  if (!battery_ids(&conf.battery, 1)) errx(1, "no batteries detected");
+}
+
+
+
+/* draw into memory instead of an X window: 1 frame for --render-to
+   or a lot of them for --render-bench, where every frame shows
+   another synthetic battery state */
+static
+void headless(Battery *bt) {
+  offscreen_open(SIZE, SIZE);
+  if (!dockapp_xpm2pixmap(backlight_off_xpm, &backdrop_off, NULL, NULL, 0))
+    errx(1, "error initializing bg image");
+  backlight_setup(bt);
+  frames_create();
+
+  if (conf.render_to) {
+    draw_all_the_digits(*bt);
+    if (!offscreen_write_ppm(conf.render_to)) err(1, "%s", conf.render_to);
+    exit(0);
+  }
+
+  struct timespec start, end;
+  unsigned long requests = dockapp_nrequests;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (int i = 0; i < conf.render_bench; ++i) {
+    Battery b = {
+      .capacity = i % 101,
+      .seconds_remaining = i * 37 % (10*3600),
+      .is_charging = i / 101 % 2,
+      .is_ac_power = i / 202 % 2
+    };
+    conf.backlight = i / 404 % 2 ? LIGHTON : LIGHTOFF;
+    draw_all_the_digits(b);
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
 
-  int *bt_list = battery_list();
-  if (!bt_list) errx(1, "no batteries detected");
-  conf.battery = bt_list[0];
-  free(bt_list);
+  double sec = end.tv_sec - start.tv_sec + (end.tv_nsec - start.tv_nsec) / 1e9;
+  printf("%d frames, %.0f frames/s, %.1f copies/frame\n", conf.render_bench,
+	 conf.render_bench / sec,
+	 (double)(dockapp_nrequests - requests) / conf.render_bench);
+  exit(0);
 }
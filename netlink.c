@@ -0,0 +1,47 @@
+#define _GNU_SOURCE
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
+#include "netlink.h"
+
+int netlink_open() {
+  int fd = socket(AF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC | SOCK_NONBLOCK,
+		  NETLINK_KOBJECT_UEVENT);
+  if (fd == -1) return -1;
+
+  struct sockaddr_nl addr = {
+    .nl_family = AF_NETLINK,
+    .nl_groups = 1		// the kernel, not udevd
+  };
+  if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) == -1) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+ssize_t netlink_read(int fd, char *buf, size_t size) {
+  struct sockaddr_nl addr;
+  struct iovec iov = { buf, size };
+  struct msghdr msg = {
+    .msg_name = &addr, .msg_namelen = sizeof(addr),
+    .msg_iov = &iov, .msg_iovlen = 1
+  };
+
+  ssize_t len = recvmsg(fd, &msg, 0);
+  if (len <= 0) return -1;
+  if (addr.nl_pid != 0 || msg.msg_flags & MSG_TRUNC) return 0;
+
+  // "action@devpath\0KEY=VAL\0KEY=VAL\0..."
+  const char subsystem[] = "\0SUBSYSTEM=power_supply";
+  char *p = memmem(buf, len, subsystem, sizeof(subsystem) - 1);
+  if (!p) return 0;
+  p += sizeof(subsystem) - 1;
+  return p == buf + len || *p == '\0' ? len : 0;
+}
+
+bool netlink_is_hotplug(const char *msg, size_t len) {
+  return (len > 4 && memcmp(msg, "add@", 4) == 0)
+    || (len > 7 && memcmp(msg, "remove@", 7) == 0);
+}
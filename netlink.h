@@ -0,0 +1,17 @@
+#ifndef NETLINK_H
+#define NETLINK_H
+
+#include <stdbool.h>
+#include <sys/types.h>
+
+// return a non-blocking socket subscribed to the kernel kobject
+// uevents or -1 on error
+int netlink_open();
+// read the next message; return its length if it's about a power
+// supply, 0 if it's about something else, -1 if there are no more
+// pending messages
+ssize_t netlink_read(int, char*, size_t);
+// true if the message is about an added or removed device
+bool netlink_is_hotplug(const char*, size_t);
+
+#endif
@@ -0,0 +1,228 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "dockapp.h"
+#include "offscreen.h"
+
+#define MAX_IMAGES 16
+
+typedef struct Image {
+  int w, h;
+  uint32_t *px;
+} Image;
+
+static Image images[MAX_IMAGES];	// a Pixmap is an index + 1
+static int nimages = 0;
+static Image window;
+
+static
+Pixmap image_new(int w, int h) {
+  if (nimages == MAX_IMAGES) return None;
+  Image *img = &images[nimages];
+  img->px = calloc(w * h, sizeof(uint32_t));
+  if (!img->px) return None;
+  img->w = w;
+  img->h = h;
+  return ++nimages;
+}
+
+static
+Image *image(Pixmap p) {
+  return p > 0 && p <= (Pixmap)nimages ? &images[p - 1] : NULL;
+}
+
+static
+Pixmap create_pixmap(int w, int h) { return image_new(w, h); }
+
+// #rgb, #rrggbb, #rrrrggggbbbb or rgb:r/g/b w/ 1-4 hex digits per
+// channel
+static
+Bool parse_color(char *name, XColor *color) {
+  unsigned short *ch[] = { &color->red, &color->green, &color->blue };
+
+  if (name[0] == '#') {
+    size_t len = strlen(name + 1);
+    if (len % 3 || !len || len > 12) return False;
+    int digits = len / 3;
+    for (int i = 0; i < 3; ++i) {
+      char buf[5];
+      memcpy(buf, name + 1 + i * digits, digits);
+      buf[digits] = '\0';
+      char *end;
+      unsigned long v = strtoul(buf, &end, 16);
+      if (*end) return False;
+      *ch[i] = v << (16 - digits * 4); // like XParseColor
+    }
+  } else if (strncasecmp(name, "rgb:", 4) == 0) {
+    char *p = name + 4;
+    for (int i = 0; i < 3; ++i) {
+      char *end;
+      unsigned long v = strtoul(p, &end, 16);
+      int digits = end - p;
+      if (digits < 1 || digits > 4 || (i < 2 && *end != '/')
+	  || (i == 2 && *end)) return False;
+      *ch[i] = v * 0xffff / ((1UL << digits * 4) - 1); // scaled
+      p = end + 1;
+    }
+  } else {
+    return False;		// no rgb.txt here
+  }
+  color->flags = DoRed | DoGreen | DoBlue;
+  return True;
+}
+
+static
+Bool alloc_color(XColor *color) {
+  color->pixel = (color->red >> 8) << 16 | (color->green >> 8) << 8
+    | color->blue >> 8;
+  return True;
+}
+
+static
+int depth() { return 24; }
+
+typedef struct XpmColor {
+  char chars[4];
+  uint32_t px;
+} XpmColor;
+
+// "<chars> c <color> s <symbol>", the other contexts are ignored
+static
+bool xpm_color(const char *line, int cpp, XpmColor *c,
+	       XpmColorSymbol *symbols, unsigned nsymbols) {
+  memcpy(c->chars, line, cpp);
+
+  char spec[64] = "", sym[64] = "", key[8], val[64];
+  const char *p = line + cpp;
+  int n;
+  while (sscanf(p, " %7s %63s%n", key, val, &n) == 2) {
+    if (strcmp(key, "c") == 0) strcpy(spec, val);
+    else if (strcmp(key, "s") == 0) strcpy(sym, val);
+    p += n;
+  }
+
+  for (unsigned i = 0; sym[0] && i < nsymbols; ++i) {
+    if (strcmp(symbols[i].name, sym)) continue;
+    if (!symbols[i].value) {
+      c->px = 0xff000000 | symbols[i].pixel;
+      return true;
+    }
+    snprintf(spec, sizeof(spec), "%s", symbols[i].value);
+  }
+
+  if (strcasecmp(spec, "None") == 0) {
+    c->px = 0;			// transparent black
+    return true;
+  }
+  XColor color;
+  if (!parse_color(spec, &color)) return false;
+  alloc_color(&color);
+  c->px = 0xff000000 | color.pixel;
+  return true;
+}
+
+// decode the xpm once; the mask is opaque white where the image is
+static
+Bool xpm2pixmap(char **data, Pixmap *pixmap, Pixmap *mask,
+		XpmColorSymbol *symbols, unsigned nsymbols) {
+  int w, h, ncolors, cpp;
+  if (sscanf(data[0], "%d %d %d %d", &w, &h, &ncolors, &cpp) != 4
+      || cpp < 1 || cpp > 4) return False;
+
+  XpmColor *colors = malloc(ncolors * sizeof(XpmColor));
+  if (!colors) return False;
+  for (int i = 0; i < ncolors; ++i)
+    if (!xpm_color(data[1 + i], cpp, &colors[i], symbols, nsymbols)) {
+      free(colors);
+      return False;
+    }
+
+  Pixmap p = image_new(w, h), m = mask ? image_new(w, h) : None;
+  Image *img = image(p), *img_mask = image(m);
+  if (!img || (mask && !img_mask)) {
+    free(colors);
+    return False;
+  }
+
+  for (int y = 0; y < h; ++y) {
+    const char *row = data[1 + ncolors + y];
+    for (int x = 0; x < w; ++x, row += cpp) {
+      uint32_t px = 0;
+      for (int i = 0; i < ncolors; ++i)
+	if (memcmp(colors[i].chars, row, cpp) == 0) {
+	  px = colors[i].px;
+	  break;
+	}
+      img->px[y * w + x] = px;
+      if (img_mask) img_mask->px[y * w + x] = px ? 0xffffffff : 0;
+    }
+  }
+  free(colors);
+
+  *pixmap = p;
+  if (mask) *mask = m;
+  return True;
+}
+
+static
+void blit(const Image *src, Image *dest, int x_src, int y_src, int w, int h,
+	  int x_dest, int y_dest) {
+  // clip like XCopyArea does
+  if (x_src < 0) { w += x_src; x_dest -= x_src; x_src = 0; }
+  if (y_src < 0) { h += y_src; y_dest -= y_src; y_src = 0; }
+  if (x_dest < 0) { w += x_dest; x_src -= x_dest; x_dest = 0; }
+  if (y_dest < 0) { h += y_dest; y_src -= y_dest; y_dest = 0; }
+  if (x_src + w > src->w) w = src->w - x_src;
+  if (y_src + h > src->h) h = src->h - y_src;
+  if (x_dest + w > dest->w) w = dest->w - x_dest;
+  if (y_dest + h > dest->h) h = dest->h - y_dest;
+  if (w <= 0 || h <= 0) return;
+
+  for (int y = 0; y < h; ++y)
+    memmove(&dest->px[(y_dest + y) * dest->w + x_dest],
+	    &src->px[(y_src + y) * src->w + x_src], w * sizeof(uint32_t));
+}
+
+static
+void copyarea(Pixmap src, Pixmap dest, int x_src, int y_src, int w, int h,
+	      int x_dest, int y_dest) {
+  Image *s = image(src), *d = image(dest);
+  if (s && d) blit(s, d, x_src, y_src, w, h, x_dest, y_dest);
+}
+
+static
+void copy2window(Pixmap src) {
+  Image *s = image(src);
+  if (s) blit(s, &window, 0, 0, window.w, window.h, 0, 0);
+}
+
+static const DockappBackend backend = {
+  xpm2pixmap, create_pixmap, copyarea, copy2window,
+  parse_color, alloc_color, depth
+};
+
+void offscreen_open(int w, int h) {
+  window.w = w;
+  window.h = h;
+  window.px = calloc(w * h, sizeof(uint32_t));
+  if (!window.px) abort();
+  dockapp_set_backend(&backend);
+}
+
+const uint32_t *offscreen_window() { return window.px; }
+
+bool offscreen_write_ppm(const char *file) {
+  FILE *fp = fopen(file, "wb");
+  if (!fp) return false;
+
+  fprintf(fp, "P6\n%d %d\n255\n", window.w, window.h);
+  for (int i = 0; i < window.w * window.h; ++i) {
+    uint32_t px = window.px[i];
+    unsigned char rgb[] = { px >> 16, px >> 8, px };
+    fwrite(rgb, 1, 3, fp);
+  }
+  bool ok = !ferror(fp);
+  return fclose(fp) == 0 && ok;
+}
@@ -0,0 +1,16 @@
+#ifndef OFFSCREEN_H
+#define OFFSCREEN_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// an in-memory backend for dockapp: pixmaps are 0xAARRGGBB arrays &
+// only #rgb or rgb:r/g/b colors are understood; for the benchmarks &
+// the golden images, no X server required
+void offscreen_open(int, int);
+// the window as the last dockapp_copy2window() left it
+const uint32_t *offscreen_window();
+// return false on error
+bool offscreen_write_ppm(const char*);
+
+#endif
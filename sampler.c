@@ -0,0 +1,106 @@
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <string.h>
+#include <signal.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include "sampler.h"
+
+static struct {
+  sampler_update_fn update;
+  sampler_watch_fn on_watch;
+  int watch_fd;
+  int kick_fd;			// main thread -> worker
+  int ready_fd;			// worker -> main thread
+  Battery current;		// owned by the worker
+
+  // a seqlock: odd while the worker is writing the snapshot
+  atomic_uint seq;
+  Battery snapshot;
+} sampler = { .watch_fd = -1, .kick_fd = -1, .ready_fd = -1 };
+
+static
+void publish(const Battery *bt) {
+  unsigned seq = atomic_load_explicit(&sampler.seq, memory_order_relaxed);
+  atomic_store_explicit(&sampler.seq, seq + 1, memory_order_relaxed);
+  atomic_thread_fence(memory_order_release);
+  memcpy(&sampler.snapshot, bt, sizeof(Battery));
+  atomic_store_explicit(&sampler.seq, seq + 2, memory_order_release);
+
+  uint64_t one = 1;
+  if (write(sampler.ready_fd, &one, sizeof(one))) {}
+}
+
+void sampler_get(Battery *bt) {
+  uint64_t count;
+  if (read(sampler.ready_fd, &count, sizeof(count))) {}
+
+  unsigned seq0, seq1;
+  do {
+    seq0 = atomic_load_explicit(&sampler.seq, memory_order_acquire);
+    memcpy(bt, &sampler.snapshot, sizeof(Battery));
+    atomic_thread_fence(memory_order_acquire);
+    seq1 = atomic_load_explicit(&sampler.seq, memory_order_relaxed);
+  } while (seq0 & 1 || seq0 != seq1);
+}
+
+void sampler_kick() {
+  uint64_t one = 1;
+  if (write(sampler.kick_fd, &one, sizeof(one))) {}
+}
+
+int sampler_fd() { return sampler.ready_fd; }
+
+static
+void *worker(void *arg) {
+  (void)arg;
+  struct pollfd fds[2] = {
+    { .fd = sampler.kick_fd, .events = POLLIN },
+    { .fd = sampler.watch_fd, .events = POLLIN } // ignored if -1
+  };
+
+  for (;;) {
+    if (poll(fds, 2, -1) <= 0) continue;
+
+    bool changed = false;
+    if (fds[1].revents & POLLIN)
+      changed = sampler.on_watch(sampler.watch_fd, &sampler.current);
+    if (fds[0].revents & POLLIN) {
+      uint64_t count;
+      if (read(sampler.kick_fd, &count, sizeof(count))) {}
+      sampler.update(&sampler.current);
+      changed = true;
+    }
+    if (changed) publish(&sampler.current);
+  }
+  return NULL;
+}
+
+bool sampler_start(const Battery *initial, sampler_update_fn update,
+		   int watch_fd, sampler_watch_fn on_watch) {
+  sampler.update = update;
+  sampler.on_watch = on_watch;
+  sampler.watch_fd = watch_fd;
+  sampler.current = *initial;
+  sampler.snapshot = *initial;
+
+  sampler.kick_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+  sampler.ready_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+  if (sampler.kick_fd == -1 || sampler.ready_fd == -1) return false;
+
+  // signals are for the main thread only
+  sigset_t all, old;
+  sigfillset(&all);
+  pthread_sigmask(SIG_SETMASK, &all, &old);
+
+  pthread_t thread;
+  int r = pthread_create(&thread, NULL, worker, NULL);
+  pthread_sigmask(SIG_SETMASK, &old, NULL);
+  if (r != 0) return false;
+
+  pthread_detach(thread);
+  return true;
+}
@@ -0,0 +1,23 @@
+#ifndef SAMPLER_H
+#define SAMPLER_H
+
+#include <stdbool.h>
+#include "battery.h"
+
+// both callbacks run in the worker thread & update the battery in
+// place; the watch callback returns true if the battery has changed
+typedef void (*sampler_update_fn)(Battery*);
+typedef bool (*sampler_watch_fn)(int, Battery*);
+
+// start a thread that owns all the sysfs reads: it calls update() on
+// every sampler_kick() & on_watch() when watch_fd (may be -1) is
+// readable; return false on error
+bool sampler_start(const Battery*, sampler_update_fn, int, sampler_watch_fn);
+// ask for a new sample; never blocks
+void sampler_kick();
+// readable when a new snapshot is published
+int sampler_fd();
+// copy the latest snapshot; never blocks on the worker
+void sampler_get(Battery*);
+
+#endif
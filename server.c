@@ -0,0 +1,171 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include "dockapp.h"
+#include "server.h"
+
+typedef struct Client {
+  int fd;			// -1 if the slot is free
+  bool subscribed;
+} Client;
+
+static struct {
+  int fd;			// listening
+  char path[sizeof(((struct sockaddr_un*)0)->sun_path)];
+  Client clients[SERVER_MAX_CLIENTS];
+  Battery last;
+  bool known;			// last is set
+  char record[256];		// last, formatted once for everyone
+  int len;
+} server = { .fd = -1 };
+
+const char *server_default_path() {
+  static char path[sizeof(server.path)];
+  const char *dir = getenv("XDG_RUNTIME_DIR");
+  if (dir && *dir)
+    snprintf(path, sizeof(path), "%s/wmvolt.sock", dir);
+  else
+    snprintf(path, sizeof(path), "/tmp/wmvolt-%u.sock", (unsigned)getuid());
+  return path;
+}
+
+static
+void client_drop(Client *c) {
+  dockapp_remove_input(c->fd);
+  close(c->fd);
+  c->fd = -1;
+  c->subscribed = false;
+}
+
+// a full send buffer means the client doesn't keep up
+static
+void client_send(Client *c, const char *msg, int len) {
+  if (send(c->fd, msg, len, MSG_DONTWAIT | MSG_NOSIGNAL) != len)
+    client_drop(c);
+}
+
+static
+void on_request(int fd, void *data) {
+  Client *c = data;
+  char msg[32];
+  ssize_t len = recv(fd, msg, sizeof(msg) - 1, MSG_DONTWAIT);
+  if (len == -1 && (errno == EAGAIN || errno == EINTR)) return;
+  if (len <= 0) {		// hung up
+    client_drop(c);
+    return;
+  }
+  if (msg[len - 1] == '\n') len--;
+  msg[len] = '\0';
+
+  if (strcmp(msg, "SUBSCRIBE") == 0)
+    c->subscribed = true;
+  else if (strcmp(msg, "GET") != 0) {
+    static const char e[] = "ERR unknown request\n";
+    client_send(c, e, sizeof(e) - 1);
+    return;
+  }
+  if (server.known) client_send(c, server.record, server.len);
+}
+
+static
+void on_connect(int fd, void *data) {
+  (void)data;
+  int cfd = accept4(fd, NULL, NULL, SOCK_CLOEXEC | SOCK_NONBLOCK);
+  if (cfd == -1) return;
+
+  Client *c = NULL;
+  for (int i = 0; i < SERVER_MAX_CLIENTS && !c; ++i)
+    if (server.clients[i].fd == -1) c = &server.clients[i];
+
+  int size = SERVER_SNDBUF;
+  if (!c
+      || setsockopt(cfd, SOL_SOCKET, SO_SNDBUF, &size, sizeof(size)) == -1
+      || !dockapp_add_input(cfd, on_request, c)) {
+    close(cfd);			// too many clients
+    return;
+  }
+  c->fd = cfd;
+  c->subscribed = false;
+}
+
+// a socket file nobody listens on is left by a crash; another
+// instance that still listens keeps its endpoint
+static
+bool stale_removed(const struct sockaddr_un *addr) {
+  struct stat st;
+  if (lstat(addr->sun_path, &st) == -1 || !S_ISSOCK(st.st_mode)) return true;
+
+  int fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+  if (fd == -1) return false;
+  int r = connect(fd, (const struct sockaddr*)addr, sizeof(*addr));
+  int e = errno;
+  close(fd);
+
+  if (r == 0 || e == EAGAIN) {	// alive, maybe w/ a full backlog
+    errno = EADDRINUSE;
+    return false;
+  }
+  if (e == ECONNREFUSED) unlink(addr->sun_path);
+  return true;			// bind() reports the rest
+}
+
+bool server_open(const char *path) {
+  struct sockaddr_un addr = { .sun_family = AF_UNIX };
+  if (strlen(path) >= sizeof(addr.sun_path)) {
+    errno = ENAMETOOLONG;
+    return false;
+  }
+  strcpy(addr.sun_path, path);
+  if (!stale_removed(&addr)) return false;
+
+  for (int i = 0; i < SERVER_MAX_CLIENTS; ++i) server.clients[i].fd = -1;
+
+  server.fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC | SOCK_NONBLOCK,
+		     0);
+  if (server.fd == -1) return false;
+
+  // only the owner may connect
+  mode_t mask = umask(077);
+  int r = bind(server.fd, (struct sockaddr*)&addr, sizeof(addr));
+  umask(mask);
+
+  if (r == -1 || listen(server.fd, SERVER_MAX_CLIENTS) == -1
+      || !dockapp_add_input(server.fd, on_connect, NULL)) {
+    int e = errno;
+    close(server.fd);
+    server.fd = -1;
+    errno = e;
+    return false;
+  }
+  strcpy(server.path, path);
+  return true;
+}
+
+void server_publish(const Battery *bt) {
+  if (server.fd == -1) return;
+  if (server.known && battery_equal(&server.last, bt)) return;
+  server.last = *bt;
+  server.known = true;
+  server.len = snprintf(server.record, sizeof(server.record),
+			"id=%d ac=%d charging=%d capacity=%d"
+			" seconds_remaining=%d energy_now=%ld"
+			" energy_full=%ld power=%ld\n",
+			bt->id, bt->is_ac_power, bt->is_charging,
+			bt->capacity, bt->seconds_remaining, bt->energy_now,
+			bt->energy_full, bt->power);
+
+  for (int i = 0; i < SERVER_MAX_CLIENTS; ++i) {
+    Client *c = &server.clients[i];
+    if (c->fd != -1 && c->subscribed) client_send(c, server.record, server.len);
+  }
+}
+
+void server_close() {
+  if (server.fd != -1) unlink(server.path);
+}
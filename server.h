@@ -0,0 +1,29 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <stdbool.h>
+#include "battery.h"
+
+// a local AF_UNIX SOCK_SEQPACKET endpoint in the dockapp event loop;
+// a client sends "GET" for 1 record or "SUBSCRIBE" for 1 record now
+// & another every time the battery changes. A record is a line of
+// KEY=VAL pairs, the keys of wmvolt-read
+#define SERVER_MAX_CLIENTS 32
+// what a client may leave unread (~10 records); a subscriber that
+// falls behind more is dropped instead of queueing forever
+#define SERVER_SNDBUF 8192
+
+// $XDG_RUNTIME_DIR/wmvolt.sock or /tmp/wmvolt-<uid>.sock; a static
+// buffer
+const char *server_default_path();
+
+// replace a stale socket file & listen; return false on error, w/
+// errno set to EADDRINUSE if another process listens on the path
+bool server_open(const char*);
+// send the battery to the subscribers if any of its fields differ
+// from the last time
+void server_publish(const Battery*);
+// remove the socket file
+void server_close();
+
+#endif
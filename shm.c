@@ -0,0 +1,134 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "shm.h"
+
+#define SPINS 1000		// before a reader gives up on a dead writer
+
+const char *shm_default_name() {
+  static char name[32];
+  snprintf(name, sizeof(name), "/wmvolt-%u", (unsigned)getuid());
+  return name;
+}
+
+ShmSegment *shm_create(const char *name) {
+  int fd = shm_open(name, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+  if (fd == -1) return NULL;
+
+  // the name is predictable: another user could have created the
+  // segment first & kept a writable mapping of it to feed our readers
+  struct stat st;
+  int r = fstat(fd, &st);
+  if (r == 0 && (st.st_uid != geteuid() || st.st_mode & (S_IWGRP | S_IWOTH))) {
+    errno = EACCES;
+    r = -1;
+  }
+  // 2 writers would break the seqlock; the lock goes away w/ the
+  // process, so the fd stays open until then
+  if (r == 0 && flock(fd, LOCK_EX | LOCK_NB) == -1) {
+    if (errno == EWOULDBLOCK) errno = EBUSY;
+    r = -1;
+  }
+  if (r == -1) {
+    close(fd);
+    return NULL;
+  }
+
+  ShmSegment *seg = MAP_FAILED;
+  if (ftruncate(fd, sizeof(ShmSegment)) == 0)
+    seg = mmap(NULL, sizeof(ShmSegment), PROT_READ | PROT_WRITE, MAP_SHARED,
+	       fd, 0);
+  if (seg == MAP_FAILED) {
+    close(fd);
+    return NULL;
+  }
+
+  // keep the counter of a previous writer going, so that its readers
+  // don't take the 1st new snapshot for one they've already seen
+  unsigned seq = atomic_load(&seg->seq);
+  if (seg->magic != SHM_MAGIC || seg->version != SHM_VERSION) {
+    memset(seg, 0, sizeof(ShmSegment));
+    seq = 0;
+  }
+  seg->magic = SHM_MAGIC;
+  seg->version = SHM_VERSION;
+  seg->size = sizeof(ShmSegment);
+  atomic_store(&seg->seq, (seq + 1) & ~1u);
+  return seg;
+}
+
+static
+int64_t ns(clockid_t clock) {
+  struct timespec ts;
+  clock_gettime(clock, &ts);
+  return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+void shm_write(ShmSegment *seg, const Battery *bt) {
+  ShmSnapshot s = {
+    .id = bt->id,
+    .is_ac_power = bt->is_ac_power,
+    .is_charging = bt->is_charging,
+    .capacity = bt->capacity,
+    .seconds_remaining = bt->seconds_remaining,
+    .energy_now = bt->energy_now,
+    .energy_full = bt->energy_full,
+    .power = bt->power,
+    .realtime_ns = ns(CLOCK_REALTIME),
+    .monotonic_ns = ns(CLOCK_MONOTONIC),
+    .samples = seg->snapshot.samples + 1
+  };
+
+  // the same protocol as in sampler.c, across processes
+  unsigned seq = atomic_load_explicit(&seg->seq, memory_order_relaxed);
+  atomic_store_explicit(&seg->seq, seq + 1, memory_order_relaxed);
+  atomic_thread_fence(memory_order_release);
+  memcpy(&seg->snapshot, &s, sizeof(s));
+  atomic_store_explicit(&seg->seq, seq + 2, memory_order_release);
+}
+
+void shm_remove(const char *name) { shm_unlink(name); }
+
+const ShmSegment *shm_attach(const char *name) {
+  int fd = shm_open(name, O_RDONLY | O_CLOEXEC, 0);
+  if (fd == -1) return NULL;
+
+  // a segment too small to hold the header would SIGBUS
+  struct stat st;
+  const ShmSegment *seg = MAP_FAILED;
+  if (fstat(fd, &st) == 0 && st.st_size >= (off_t)sizeof(ShmSegment))
+    seg = mmap(NULL, sizeof(ShmSegment), PROT_READ, MAP_SHARED, fd, 0);
+  else
+    errno = EPROTO;
+  close(fd);
+  if (seg == MAP_FAILED) return NULL;
+
+  if (seg->magic != SHM_MAGIC || seg->version != SHM_VERSION) {
+    shm_detach(seg);
+    errno = EPROTO;
+    return NULL;
+  }
+  return seg;
+}
+
+bool shm_read(const ShmSegment *seg, ShmSnapshot *s) {
+  for (int i = 0; i < SPINS; i++) {
+    unsigned seq0 = atomic_load_explicit(&seg->seq, memory_order_acquire);
+    memcpy(s, &seg->snapshot, sizeof(*s));
+    atomic_thread_fence(memory_order_acquire);
+    unsigned seq1 = atomic_load_explicit(&seg->seq, memory_order_relaxed);
+    if (!(seq0 & 1) && seq0 == seq1) return s->samples != 0;
+  }
+  return false;
+}
+
+void shm_detach(const ShmSegment *seg) {
+  munmap((void*)seg, sizeof(ShmSegment));
+}
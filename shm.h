@@ -0,0 +1,59 @@
+#ifndef SHM_H
+#define SHM_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include "battery.h"
+
+// the latest battery state in a POSIX shared memory segment, for the
+// other programs that would otherwise reread sysfs; a reader maps it
+// once & then gets a snapshot w/o any syscalls
+
+#define SHM_MAGIC   0x746c6f76	// "volt"
+#define SHM_VERSION 1
+
+// fixed-size fields, the same for every compiler
+typedef struct ShmSnapshot {
+  int32_t id;			// or BATTERY_ALL
+  uint8_t is_ac_power;
+  uint8_t is_charging;
+  uint16_t pad;
+  int32_t capacity;		// %
+  int32_t seconds_remaining;
+  int64_t energy_now;		// µWh, -1 if unknown
+  int64_t energy_full;		// µWh, -1 if unknown
+  int64_t power;		// µW, -1 if unknown
+  int64_t realtime_ns;		// when it was sampled
+  int64_t monotonic_ns;
+  uint64_t samples;		// published so far
+} ShmSnapshot;
+
+typedef struct ShmSegment {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t size;		// of the segment
+  atomic_uint seq;		// a seqlock: odd while it's being written
+  ShmSnapshot snapshot;
+} ShmSegment;
+
+// "/wmvolt-<uid>"; a static buffer
+const char *shm_default_name();
+
+// the writer: create (or take over one of our own) a segment; NULL on
+// error, w/ errno set to EACCES if somebody else can write into it or
+// to EBUSY if another writer is still alive
+ShmSegment *shm_create(const char*);
+void shm_write(ShmSegment*, const Battery*);
+// remove the segment; the mappings stay valid
+void shm_remove(const char*);
+
+// the readers: map a segment read-only; NULL on error, w/ errno set
+// to EPROTO if it is from an incompatible writer
+const ShmSegment *shm_attach(const char*);
+// copy a consistent snapshot; false if there's none yet or the
+// writer died in the middle of an update
+bool shm_read(const ShmSegment*, ShmSnapshot*);
+void shm_detach(const ShmSegment*);
+
+#endif
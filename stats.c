@@ -0,0 +1,91 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <unistd.h>
+#include "stats.h"
+
+#define BUCKETS 64		// bucket #i holds [2^(i-1), 2^i) ns
+
+typedef struct Histogram {
+  atomic_ulong count;
+  atomic_ulong sum;		// ns
+  atomic_ulong max;
+  atomic_ulong buckets[BUCKETS];
+} Histogram;
+
+static Histogram stages[STAGE_COUNT];
+static atomic_ulong counters[COUNTER_COUNT];
+static uint64_t started;
+
+static const char *stage_names[] = {
+  "read", "parse", "ac_power", "compute", "draw", "flush", "tick"
+};
+static const char *counter_names[] = {
+  "ticks", "sysfs_syscalls", "epoll_waits", "x_requests"
+};
+
+uint64_t stats_now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+void stats_stage(Stage stage, uint64_t start) {
+  uint64_t ns = stats_now() - start;
+  Histogram *h = &stages[stage];
+  int bucket = ns ? 64 - __builtin_clzll(ns) : 0;
+  if (bucket >= BUCKETS) bucket = BUCKETS - 1;
+
+  // relaxed: the numbers of a dump needn't agree w/ each other
+  atomic_fetch_add_explicit(&h->count, 1, memory_order_relaxed);
+  atomic_fetch_add_explicit(&h->sum, ns, memory_order_relaxed);
+  atomic_fetch_add_explicit(&h->buckets[bucket], 1, memory_order_relaxed);
+  unsigned long max = atomic_load_explicit(&h->max, memory_order_relaxed);
+  while (ns > max && !atomic_compare_exchange_weak_explicit
+	 (&h->max, &max, ns, memory_order_relaxed, memory_order_relaxed)) ;
+}
+
+void stats_count(Counter counter, unsigned long n) {
+  atomic_fetch_add_explicit(&counters[counter], n, memory_order_relaxed);
+}
+
+__attribute__((constructor))
+static void stats_start() { started = stats_now(); }
+
+bool stats_dump(FILE *fp) {
+  fprintf(fp, "uptime sec=%.3f\n", (stats_now() - started) / 1e9);
+  for (int i = 0; i < COUNTER_COUNT; ++i)
+    fprintf(fp, "%s total=%lu\n", counter_names[i],
+	    atomic_load_explicit(&counters[i], memory_order_relaxed));
+
+  for (int i = 0; i < STAGE_COUNT; ++i) {
+    Histogram *h = &stages[i];
+    fprintf(fp, "%s count=%lu sum_ns=%lu max_ns=%lu", stage_names[i],
+	    atomic_load_explicit(&h->count, memory_order_relaxed),
+	    atomic_load_explicit(&h->sum, memory_order_relaxed),
+	    atomic_load_explicit(&h->max, memory_order_relaxed));
+    for (int b = 0; b < BUCKETS; ++b) {
+      unsigned long n = atomic_load_explicit(&h->buckets[b],
+					     memory_order_relaxed);
+      if (n) fprintf(fp, " le_%llu=%lu", b ? (1ULL << b) - 1 : 0, n);
+    }
+    fputc('\n', fp);
+  }
+  return fflush(fp) == 0 && !ferror(fp);
+}
+
+bool stats_dump_to(const char *file) {
+  char tmp[FILENAME_MAX];
+  snprintf(tmp, sizeof(tmp), "%s.tmp", file);
+  FILE *fp = fopen(tmp, "w");
+  if (!fp) return false;
+
+  bool ok = stats_dump(fp);
+  if (fclose(fp) != 0 || !ok || rename(tmp, file) != 0) {
+    unlink(tmp);
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,43 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// always-on timings of the hot path; every stage keeps a histogram
+// w/ log2 buckets; safe to update from any thread
+typedef enum {
+  STAGE_READ,			// sysfs reads of a battery session
+  STAGE_PARSE,
+  STAGE_AC_POWER,
+  STAGE_COMPUTE,
+  STAGE_DRAW,
+  STAGE_FLUSH,			// XFlush() before waiting
+  STAGE_TICK,			// a sample request -> the frame is drawn
+  STAGE_COUNT
+} Stage;
+
+typedef enum {
+  COUNTER_TICKS,
+  // not every syscall: the timerfd/eventfd/signalfd reads & writes &
+  // the X socket traffic aren't counted
+  COUNTER_SYSFS_SYSCALLS,	// preads or io_uring_enters
+  COUNTER_WAITS,		// epoll_waits
+  COUNTER_X_REQUESTS,
+  COUNTER_COUNT
+} Counter;
+
+// CLOCK_MONOTONIC in ns
+uint64_t stats_now();
+// record a stage that started at stats_now()
+void stats_stage(Stage, uint64_t);
+void stats_count(Counter, unsigned long);
+// "name key=val ..." lines, 1 per stage or counter; the histogram
+// keys are le_<ns>=<count> for the non-empty buckets; return false on
+// a write error
+bool stats_dump(FILE*);
+// dump into a temporary file & rename it over the file
+bool stats_dump_to(const char*);
+
+#endif
@@ -0,0 +1,113 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "stream.h"
+
+#define RECORD_MAX 256
+
+static struct {
+  int fd;
+  StreamFormat format;
+  bool batch;			// a regular file
+  time_t flushed;		// monotonic sec
+  Battery last;
+  bool known;			// last is set
+  size_t len;
+  char buf[BUFSIZ];		// reused for every batch
+} stream = { .fd = -1 };
+
+static
+time_t uptime() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec;
+}
+
+bool stream_flush() {
+  for (size_t done = 0; done < stream.len; ) {
+    ssize_t n = write(stream.fd, stream.buf + done, stream.len - done);
+    if (n == -1 && errno == EINTR) continue;
+    if (n == -1) return false;
+    done += n;
+  }
+  stream.len = 0;
+  stream.flushed = uptime();
+  return true;
+}
+
+static
+void append(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+
+static
+void append(const char *fmt, ...) {
+  va_list ap;
+  va_start(ap, fmt);
+  int n = vsnprintf(stream.buf + stream.len, sizeof(stream.buf) - stream.len,
+		    fmt, ap);
+  va_end(ap);
+  if (n > 0) stream.len += n;
+}
+
+// err() & the signal handlers all end up in exit()
+static
+void flush_at_exit() {
+  stream_flush();
+}
+
+bool stream_open(const char *file, StreamFormat format) {
+  stream.fd = STDOUT_FILENO;
+  if (file && strcmp(file, "-")) {
+    stream.fd = open(file, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (stream.fd == -1) return false;
+  }
+  struct stat st;
+  stream.batch = fstat(stream.fd, &st) == 0 && S_ISREG(st.st_mode);
+  stream.format = format;
+  stream.flushed = uptime();
+  atexit(flush_at_exit);
+
+  // a new file only, so that the appended records stay 1 table
+  if (format == STREAM_CSV && (!stream.batch || st.st_size == 0)) {
+    append("time,id,ac,charging,capacity,seconds_remaining,"
+	   "energy_now,energy_full,power\n");
+    return stream_flush();
+  }
+  return true;
+}
+
+bool stream_write(const Battery *bt) {
+  if (stream.known && battery_equal(&stream.last, bt)) return true;
+  stream.last = *bt;
+  stream.known = true;
+
+  if (sizeof(stream.buf) - stream.len < RECORD_MAX && !stream_flush())
+    return false;
+
+  char ts[21];
+  time_t now = time(NULL);
+  struct tm tm;
+  strftime(ts, sizeof(ts), "%FT%TZ", gmtime_r(&now, &tm));
+
+  if (stream.format == STREAM_JSON)
+    append("{\"time\":\"%s\",\"id\":%d,\"ac\":%s,\"charging\":%s,"
+	   "\"capacity\":%d,\"seconds_remaining\":%d,\"energy_now\":%ld,"
+	   "\"energy_full\":%ld,\"power\":%ld}\n", ts, bt->id,
+	   bt->is_ac_power ? "true" : "false",
+	   bt->is_charging ? "true" : "false", bt->capacity,
+	   bt->seconds_remaining, bt->energy_now, bt->energy_full, bt->power);
+  else
+    append("%s,%d,%d,%d,%d,%d,%ld,%ld,%ld\n", ts, bt->id, bt->is_ac_power,
+	   bt->is_charging, bt->capacity, bt->seconds_remaining,
+	   bt->energy_now, bt->energy_full, bt->power);
+
+  if (!stream.batch || uptime() - stream.flushed >= STREAM_FLUSH_INTERVAL)
+    return stream_flush();
+  return true;
+}
@@ -0,0 +1,21 @@
+#ifndef STREAM_H
+#define STREAM_H
+
+#include <stdbool.h>
+#include "battery.h"
+
+// the records of --stream, 1 per change of the battery: JSON Lines
+// or CSV w/ a header. A pipe or a tty gets every record at once; a
+// regular file gets them in batches, at least every
+// STREAM_FLUSH_INTERVAL & on exit()
+typedef enum { STREAM_JSON, STREAM_CSV } StreamFormat;
+
+#define STREAM_FLUSH_INTERVAL 60 // sec
+
+// NULL or "-" is stdout; return false on error
+bool stream_open(const char*, StreamFormat);
+// return false on a write error
+bool stream_write(const Battery*);
+bool stream_flush();
+
+#endif
@@ -0,0 +1,164 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "supply.h"
+
+static const char *root = "/sys/class/power_supply";
+static SupplyList registry;
+static bool scanned = false;
+
+void supply_set_root(const char *dir) {
+  root = dir;
+  scanned = false;
+}
+
+const char *supply_root() { return root; }
+
+void supply_path(const Supply *supply, const char *attr,
+		 char *buf, size_t size) {
+  snprintf(buf, size, "%s/%s/%s", root, supply->name, attr);
+}
+
+// read a short sysfs attribute w/o the trailing newline; return
+// false if there is no such attr
+static
+bool attr_read(const Supply *supply, const char *attr,
+	       char *buf, size_t size) {
+  char path[FILENAME_MAX];
+  supply_path(supply, attr, path, sizeof(path));
+
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd == -1) return false;
+  ssize_t len = read(fd, buf, size - 1);
+  close(fd);
+  if (len == -1) return false;
+
+  while (len && isspace(buf[len-1])) len--;
+  buf[len] = '\0';
+  return true;
+}
+
+static
+SupplyType supply_type(const Supply *supply) {
+  char val[32];
+  if (!attr_read(supply, "type", val, sizeof(val))) return SUPPLY_UNKNOWN;
+
+  if (strcmp(val, "Mains") == 0) return SUPPLY_MAINS;
+  if (strcmp(val, "UPS") == 0) return SUPPLY_UPS;
+  if (strncmp(val, "USB", 3) == 0) return SUPPLY_USB; // USB_C, USB_PD, ...
+  if (strcmp(val, "Battery") == 0) {
+    // a wireless mouse or a gamepad reports its own battery
+    if (attr_read(supply, "scope", val, sizeof(val))
+	&& strcmp(val, "Device") == 0) return SUPPLY_UNKNOWN;
+    return SUPPLY_BATTERY;
+  }
+  return SUPPLY_UNKNOWN;
+}
+
+bool supply_is_battery(const Supply *supply) {
+  return supply->type == SUPPLY_BATTERY || supply->type == SUPPLY_UPS;
+}
+
+bool supply_is_adapter(const Supply *supply) {
+  return supply->type == SUPPLY_MAINS || supply->type == SUPPLY_USB;
+}
+
+static
+const Supply *find(const SupplyList *list, const char *name) {
+  for (size_t i = 0; i < list->count; ++i)
+    if (strcmp(list->items[i].name, name) == 0) return &list->items[i];
+  return NULL;
+}
+
+// batteries & adapters have separate id spaces
+static
+bool id_is_taken(const SupplyList *list, const Supply *supply, int id) {
+  for (size_t i = 0; i < list->count; ++i)
+    if (list->items[i].id == id
+	&& supply_is_battery(&list->items[i]) == supply_is_battery(supply))
+      return true;
+  return false;
+}
+
+// BAT0 -> 0, CMB1 -> 1; a supply that we've seen before keeps its id
+static
+int supply_id(const SupplyList *old, const SupplyList *list,
+	      const Supply *supply) {
+  const Supply *prev = find(old, supply->name);
+  if (prev) return prev->id;
+
+  int id = -1;
+  const char *p = supply->name + strlen(supply->name);
+  while (p > supply->name && isdigit(p[-1])) p--;
+  if (*p) id = atoi(p);
+
+  int max = -1;
+  for (size_t i = 0; i < old->count; ++i)
+    if (old->items[i].id > max) max = old->items[i].id;
+  for (size_t i = 0; i < list->count; ++i)
+    if (list->items[i].id > max) max = list->items[i].id;
+
+  if (id == -1 || id_is_taken(old, supply, id) || id_is_taken(list, supply, id))
+    id = max + 1;
+  return id;
+}
+
+static
+int supply_cmp(const void *a, const void *b) {
+  return strcmp(((Supply*)a)->name, ((Supply*)b)->name);
+}
+
+bool supply_rescan() {
+  DIR *dir = opendir(root);
+  if (!dir) return false;
+
+  SupplyList list = { NULL, 0, registry.generation + 1 };
+  size_t capacity = 0;
+  struct dirent *entry;
+  while ( (entry = readdir(dir))) {
+    if (entry->d_name[0] == '.') continue;
+    if (strlen(entry->d_name) >= sizeof(list.items->name)) continue;
+
+    if (list.count == capacity) {
+      capacity = capacity ? capacity * 2 : 8;
+      Supply *items = realloc(list.items, capacity * sizeof(Supply));
+      if (!items) break;
+      list.items = items;
+    }
+    Supply *supply = &list.items[list.count];
+    strcpy(supply->name, entry->d_name);
+    supply->type = supply_type(supply);
+    if (supply->type == SUPPLY_UNKNOWN) continue;
+    supply->id = -1;
+    list.count++;
+  }
+  closedir(dir);
+
+  // a stable order for the ids of the new supplies
+  qsort(list.items, list.count, sizeof(Supply), supply_cmp);
+  for (size_t i = 0; i < list.count; ++i)
+    list.items[i].id = supply_id(&registry, &list, &list.items[i]);
+
+  free(registry.items);
+  registry = list;
+  scanned = true;
+  return true;
+}
+
+const SupplyList *supply_list() {
+  if (!scanned) supply_rescan();
+  return &registry;
+}
+
+const Supply *supply_find_battery(int id) {
+  const SupplyList *list = supply_list();
+  for (size_t i = 0; i < list->count; ++i)
+    if (list->items[i].id == id && supply_is_battery(&list->items[i]))
+      return &list->items[i];
+  return NULL;
+}
@@ -0,0 +1,47 @@
+#ifndef SUPPLY_H
+#define SUPPLY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// the kernel's power_supply_type, only what we care about
+typedef enum {
+  SUPPLY_UNKNOWN,
+  SUPPLY_MAINS,
+  SUPPLY_BATTERY,
+  SUPPLY_UPS,
+  SUPPLY_USB
+} SupplyType;
+
+typedef struct Supply {
+  int id;			// stable across the rescans
+  char name[64];		// a dir name in /sys/class/power_supply
+  SupplyType type;
+} Supply;
+
+// an in-memory index of /sys/class/power_supply; it's rebuilt only
+// by supply_rescan()
+typedef struct SupplyList {
+  Supply *items;
+  size_t count;
+  unsigned generation;		// incremented on every rescan
+} SupplyList;
+
+// use another dir instead of /sys/class/power_supply (for tests)
+void supply_set_root(const char*);
+const char *supply_root();
+
+// return the registry, scanning the dir on the 1st call
+const SupplyList *supply_list();
+// return false if the dir is unreadable
+bool supply_rescan();
+
+// a battery or an ups by its id, NULL if there is no such
+const Supply *supply_find_battery(int);
+bool supply_is_battery(const Supply*);
+bool supply_is_adapter(const Supply*);
+
+// write "root/name/attr" to buf
+void supply_path(const Supply*, const char*, char*, size_t);
+
+#endif
@@ -0,0 +1,70 @@
+// the update path must not touch the heap after the startup: run
+// many simulated ticks over a fake sysfs dir & print the number of
+// the allocations they have made
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <err.h>
+#include "../battery.h"
+#include "../supply.h"
+#include "../estimator.h"
+#include "../stats.h"
+
+static unsigned long allocs = 0;
+
+// glibc's own allocator is reachable w/o dlsym(), which allocates
+extern void *__libc_malloc(size_t);
+extern void *__libc_calloc(size_t, size_t);
+extern void *__libc_realloc(void*, size_t);
+extern void __libc_free(void*);
+
+void *malloc(size_t size) { allocs++; return __libc_malloc(size); }
+void *calloc(size_t n, size_t size) { allocs++; return __libc_calloc(n, size); }
+void *realloc(void *p, size_t size) { allocs++; return __libc_realloc(p, size); }
+void free(void *p) { if (p) allocs++; __libc_free(p); }
+
+// a kobject uevent as netlink delivers it
+static const char msg[] = "change@/devices/BAT0/power_supply/BAT0\0"
+  "SUBSYSTEM=power_supply\0POWER_SUPPLY_NAME=BAT0\0"
+  "POWER_SUPPLY_STATUS=Discharging\0POWER_SUPPLY_POWER_NOW=11011000\0"
+  "POWER_SUPPLY_ENERGY_FULL=31350000\0POWER_SUPPLY_ENERGY_NOW=28006000";
+
+static
+void tick(BatterySession *all, BatterySession *one, Estimator *e, int n,
+	  char *fixture) {
+  Battery bt;
+  uint64_t start = stats_now();
+  if (!battery_session_get(all, &bt) || !battery_session_get(one, &bt))
+    errx(1, "tick %d: sampling failed", n);
+  estimator_add(e, n, &bt);
+  estimator_apply(e, &bt);
+  if (!battery_session_event(one, msg, sizeof(msg), &bt))
+    errx(1, "tick %d: the uevent was ignored", n);
+  if (!battery_get_from_file(fixture, &bt))
+    err(1, "%s", fixture);
+  stats_stage(STAGE_TICK, start);
+  stats_count(COUNTER_TICKS, 1);
+}
+
+int main(int argc, char *argv[])
+{
+  if (argc < 3) errx(1, "Usage: %s sysfs-dir file.txt [ticks]", argv[0]);
+  int ticks = argc > 3 ? atoi(argv[3]) : 10000;
+
+  supply_set_root(argv[1]);
+  BatterySession all, one;
+  if (!battery_session_open(&all, BATTERY_ALL)
+      || !battery_session_open(&one, 0)) errx(1, "no batteries");
+  Estimator e;
+  estimator_init(&e, 0.1);
+  tick(&all, &one, &e, 0, argv[2]);	// the startup
+
+  unsigned long before = allocs;
+  for (int i = 1; i <= ticks; ++i) tick(&all, &one, &e, i, argv[2]);
+  printf("%lu\n", allocs - before);
+
+  battery_session_close(&all);
+  battery_session_close(&one);
+  return 0;
+}
@@ -1,16 +1,23 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <err.h>
+#include <sys/stat.h>
 #include "../battery.h"
+#include "../supply.h"
 
 int main(int argc, char *argv[])
 {
   Battery bt;
   bool r;
-  if (argc > 1) {
+  struct stat st;
+  if (argc > 1 && stat(argv[1], &st) == 0 && S_ISDIR(st.st_mode)) {
+    // a fake /sys/class/power_supply
+    supply_set_root(argv[1]);
+    r = battery_get(argc > 2 ? atoi(argv[2]) : BATTERY_ALL, &bt);
+  } else if (argc > 1) {
     r = battery_get_from_file(argv[1], &bt);
   } else {
-    errx(1, "Usage: %s file.txt", argv[0]);
+    errx(1, "Usage: %s file.txt | dir [id]", argv[0]);
   }
   if (!r) err(1, "epic fail");
 
@@ -0,0 +1,43 @@
+// run the dockapp event loop under a real X server & print the number
+// of the synchronous round trips over all the ticks, which should be
+// 0; every reply Xlib waits for goes through _XReply(), so we
+// interpose it
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <dlfcn.h>
+#include <X11/Xlibint.h>
+#include "../dockapp.h"
+
+static unsigned long roundtrips = 0;
+
+Status _XReply(Display *dpy, xReply *rep, int extra, Bool discard) {
+  static Status (*real)(Display*, xReply*, int, Bool);
+  if (!real) real = dlsym(RTLD_NEXT, "_XReply");
+  roundtrips++;
+  return real(dpy, rep, extra, discard);
+}
+
+int main(int argc, char *argv[])
+{
+  int ticks = argc > 1 ? atoi(argv[1]) : 100;
+
+  dockapp_open_window("", "test", 58, 58, argc, argv);
+  dockapp_set_eventmask(ButtonPressMask);
+  Pixmap pixmap = dockapp_XCreatePixmap(58, 58);
+  dockapp_set_background(pixmap);
+  dockapp_show();
+
+  XEvent event;
+  while (dockapp_nextevent_or_timeout(&event, 10)) ; // settle down
+
+  unsigned long before = roundtrips;
+  for (int i = 0; i < ticks; ++i) {
+    dockapp_copyarea(pixmap, pixmap, 0, 0, 10, 20, i % 48, 7);
+    dockapp_copy2window(pixmap);
+    dockapp_nextevent_or_timeout(&event, 1);
+  }
+
+  printf("%lu\n", roundtrips - before);
+  return 0;
+}
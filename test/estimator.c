@@ -0,0 +1,87 @@
+// replay a trace built from a uevent file: the energy moves at the
+// recorded rate while the reported power spikes w/ the cpu load;
+// print the final time remaining in the raw & the smooth modes
+// (fails if the window doesn't follow the samples)
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <err.h>
+#include "../battery.h"
+#include "../estimator.h"
+
+#define STEP 10			// sec
+
+static const double load[] = { 1, 3, 1, 0.4 };
+
+// replace the value of the 1st of the keys that exists in src
+static
+void set(char *dest, const char *src, const char *k1, const char *k2,
+	 long val) {
+  const char *keys[] = { k1, k2 };
+  dest[0] = '\0';
+  bool done = false;
+  for (const char *line = src; *line; ) {
+    const char *eol = strchr(line, '\n');
+    size_t len = eol ? (size_t)(eol - line + 1) : strlen(line);
+    bool hit = false;
+    for (int i = 0; i < 2 && !done; ++i) {
+      size_t klen = strlen(keys[i]);
+      if (!strncmp(line, keys[i], klen) && line[klen] == '=') {
+	sprintf(dest + strlen(dest), "%s=%ld\n", keys[i], val);
+	hit = done = true;
+      }
+    }
+    if (!hit) strncat(dest, line, len);
+    line += len;
+  }
+}
+
+static
+long get(const char *src, const char *k1, const char *k2) {
+  const char *keys[] = { k1, k2 };
+  for (int i = 0; i < 2; ++i) {
+    const char *p = strstr(src, keys[i]);
+    if (p) return atol(p + strlen(keys[i]) + 1);
+  }
+  return -1;
+}
+
+int main(int argc, char *argv[])
+{
+  if (argc < 2) errx(1, "Usage: %s file.txt [samples]", argv[0]);
+  int samples = argc > 2 ? atoi(argv[2]) : 30;
+
+  static char orig[BUFSIZ], tmp[BUFSIZ], buf[BUFSIZ];
+  FILE *fp = fopen(argv[1], "r");
+  if (!fp) err(1, "%s", argv[1]);
+  orig[fread(orig, 1, sizeof(orig) - 1, fp)] = '\0';
+  fclose(fp);
+
+  long energy = get(orig, "POWER_SUPPLY_ENERGY_NOW", "POWER_SUPPLY_CHARGE_NOW");
+  long power = get(orig, "POWER_SUPPLY_POWER_NOW", "POWER_SUPPLY_CURRENT_NOW");
+  if (power < 0) power = -power;
+
+  Battery bt, smooth;
+  Estimator e;
+  estimator_init(&e, 0.1);
+  int sign = strstr(orig, "=Charging") ? 1 : -1;
+  for (int i = 0; i < samples; ++i) {
+    double t = i * STEP;
+    set(tmp, orig, "POWER_SUPPLY_ENERGY_NOW", "POWER_SUPPLY_CHARGE_NOW",
+	energy + sign * (long)(power * t / 3600));
+    set(buf, tmp, "POWER_SUPPLY_POWER_NOW", "POWER_SUPPLY_CURRENT_NOW",
+	(long)(power * load[i % 4]));
+    battery_parse(buf, strlen(buf), &bt);
+    estimator_add(&e, t, &bt);
+    // t0 is rebased once per a pass of the window
+    if (t - e.t0 > 2 * ESTIMATOR_WINDOW * STEP)
+      errx(1, "t0 is stale at %d", i);
+  }
+  smooth = bt;
+  estimator_apply(&e, &smooth);
+
+  printf("%d %d %d\n", bt.is_charging, bt.seconds_remaining,
+	 smooth.seconds_remaining);
+  return 0;
+}
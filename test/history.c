@@ -0,0 +1,34 @@
+// fill a history file w/ n samples, faking their age to get past
+// HISTORY_INTERVAL, reopen it & print the count & the capacities of
+// the samples that are still in the ring
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <err.h>
+#include "../history.h"
+
+int main(int argc, char **argv) {
+  if (argc != 3) errx(2, "Usage: history file n");
+  int n = atoi(argv[2]);
+
+  if (!history_open(argv[1])) err(1, "%s", argv[1]);
+  Battery bt = { .energy_now = 1000000, .power = -1 };
+  for (int i = 0; i < n; i++) {
+    bt.capacity = i % 101;
+    bt.is_charging = i & 1;
+    if (!history_add(&bt)) errx(1, "sample #%d wasn't added", i);
+    if (history_add(&bt)) errx(1, "sample #%d was added twice", i);
+    ((HistorySample*)history_get(history_count() - 1))->time -=
+      HISTORY_INTERVAL;
+  }
+
+  if (!history_open(argv[1])) err(1, "%s", argv[1]); // a restart
+  uint64_t count = history_count();
+  printf("%llu", (unsigned long long)count);
+  for (uint64_t i = count > 3 ? count - 3 : 0; i < count; i++) {
+    const HistorySample *s = history_get(i);
+    printf(" %d/%d/%d", s->capacity, s->flags, s->energy_now);
+  }
+  printf(" %s\n", history_get(count - HISTORY_SIZE - 1) ? "leak" : "-");
+  return 0;
+}
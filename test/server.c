@@ -0,0 +1,134 @@
+// talk to the socket endpoint w/o X: the dockapp event loop is
+// replaced by a poll(2) pump; print "ok" or die w/ the failed check
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <err.h>
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "../dockapp.h"
+#include "../server.h"
+
+static struct {
+  int fd;
+  dockapp_input_cb cb;
+  void *data;
+} inputs[64];
+
+Bool dockapp_add_input(int fd, dockapp_input_cb cb, void *data) {
+  for (int i = 0; i < 64; i++)
+    if (!inputs[i].cb) {
+      inputs[i].fd = fd;
+      inputs[i].cb = cb;
+      inputs[i].data = data;
+      return True;
+    }
+  return False;
+}
+
+void dockapp_remove_input(int fd) {
+  for (int i = 0; i < 64; i++)
+    if (inputs[i].cb && inputs[i].fd == fd) inputs[i].cb = NULL;
+}
+
+// dispatch until nothing is readable
+static
+void pump() {
+  for (bool busy = true; busy; ) {
+    busy = false;
+    for (int i = 0; i < 64; i++) {
+      struct pollfd p = { inputs[i].fd, POLLIN, 0 };
+      if (inputs[i].cb && poll(&p, 1, 0) == 1) {
+	inputs[i].cb(inputs[i].fd, inputs[i].data);
+	busy = true;
+      }
+    }
+  }
+}
+
+static const char *path;
+
+static
+int client(const char *request) {
+  struct sockaddr_un addr = { .sun_family = AF_UNIX };
+  strcpy(addr.sun_path, path);
+  int fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK, 0);
+  if (fd == -1 || connect(fd, (struct sockaddr*)&addr, sizeof(addr)))
+    err(1, "connect");
+  pump();
+  if (send(fd, request, strlen(request), 0) == -1) err(1, "send");
+  pump();
+  return fd;
+}
+
+// the capacity from the next record, -1 if there's none, -2 if the
+// server has hung up
+static
+int next(int fd) {
+  char buf[256];
+  ssize_t len = recv(fd, buf, sizeof(buf) - 1, 0);
+  if (len == -1 && errno == EAGAIN) return -1;
+  if (len <= 0) return -2;
+  buf[len] = '\0';
+  char *p = strstr(buf, "capacity=");
+  return p ? atoi(p + 9) : -3;
+}
+
+#define CHECK(expr) if (!(expr)) errx(1, "line %d: %s", __LINE__, #expr)
+
+int main(int argc, char **argv) {
+  if (argc != 2) errx(2, "Usage: server socket-path");
+  path = argv[1];
+
+  // a socket file left by a crash is replaced
+  struct sockaddr_un addr = { .sun_family = AF_UNIX };
+  strcpy(addr.sun_path, path);
+  unlink(path);
+  int dead = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+  if (dead == -1 || bind(dead, (struct sockaddr*)&addr, sizeof(addr)))
+    err(1, "%s", path);
+  close(dead);
+  if (!server_open(path)) err(1, "%s", path);
+
+  // a live one is not
+  CHECK(!server_open(path) && errno == EADDRINUSE);
+
+  Battery bt = { .capacity = 50, .energy_now = -1, .power = -1 };
+  server_publish(&bt);
+
+  int get = client("GET");
+  CHECK(next(get) == 50);
+  CHECK(next(get) == -1);
+
+  int sub = client("SUBSCRIBE\n");
+  int slow = client("SUBSCRIBE");
+  CHECK(next(sub) == 50);
+
+  server_publish(&bt);		// nothing has changed
+  CHECK(next(sub) == -1);
+
+  for (int i = 0; i < 100; i++) {
+    bt.capacity = i;
+    server_publish(&bt);
+    CHECK(next(sub) == i);
+  }
+  CHECK(next(get) == -1);	// not a subscriber
+
+  // the slow one has got some records & then was dropped
+  int n = 0;
+  while (next(slow) >= 0) n++;
+  CHECK(n > 0 && n < 100);
+  CHECK(next(slow) == -2);
+
+  int bad = client("HELLO");
+  CHECK(next(bad) == -3);
+
+  server_close();
+  CHECK(access(path, F_OK) == -1);
+  printf("ok\n");
+  return 0;
+}
@@ -0,0 +1,69 @@
+// a writer thread publishes n snapshots whose fields all carry the
+// same number while the main thread reads them through its own
+// mapping; print the number of the torn reads & leave the last
+// snapshot (all the fields = n) in the segment for wmvolt-read. n = 0
+// only takes over an existing segment & holds it until stdin is closed
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <err.h>
+#include "../shm.h"
+
+static ShmSegment *seg;
+static int n;
+static atomic_bool done;
+
+static
+void *writer(void *arg) {
+  (void)arg;
+  for (int i = 1; i <= n; i++) {
+    Battery bt = {
+      .id = i, .is_ac_power = i & 1, .is_charging = i & 1,
+      .capacity = i, .seconds_remaining = i,
+      .energy_now = i, .energy_full = i, .power = i
+    };
+    shm_write(seg, &bt);
+  }
+  atomic_store(&done, true);
+  return NULL;
+}
+
+static
+bool torn(const ShmSnapshot *s) {
+  int64_t i = s->id;
+  return s->is_ac_power != (i & 1) || s->is_charging != (i & 1)
+    || s->capacity != i || s->seconds_remaining != i || s->energy_now != i
+    || s->energy_full != i || s->power != i;
+}
+
+int main(int argc, char **argv) {
+  if (argc != 3) errx(2, "Usage: shm /name count");
+  n = atoi(argv[2]);
+
+  if (n) shm_remove(argv[1]);
+  if (!(seg = shm_create(argv[1]))) err(1, "%s", argv[1]);
+  if (!n) {
+    printf("ready\n");
+    fflush(stdout);
+    while (getchar() != EOF) ;
+    return 0;
+  }
+  const ShmSegment *r = shm_attach(argv[1]);
+  if (!r) err(1, "%s", argv[1]);
+
+  pthread_t thread;
+  if (pthread_create(&thread, NULL, writer, NULL)) errx(1, "pthread_create");
+
+  unsigned long bad = 0;
+  ShmSnapshot s;
+  while (!atomic_load(&done))
+    if (shm_read(r, &s) && torn(&s)) bad++;
+  pthread_join(thread, NULL);
+
+  if (!shm_read(r, &s) || s.id != n || s.samples != (uint64_t)n)
+    errx(1, "the last snapshot is lost");
+  printf("%lu\n", bad);
+  return 0;
+}
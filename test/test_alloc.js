@@ -0,0 +1,18 @@
+#!/usr/bin/env -S mocha --ui=tdd
+
+'use strict';
+
+let assert = require('assert')
+let cp = require('child_process')
+
+let out = '_build.x86_64'
+
+suite('Alloc', function() {
+    test('no allocations in 10000 ticks', function() {
+	let r = cp.spawnSync(`${__dirname}/../${out}/test/alloc`,
+			     [`${__dirname}/sysfs.dual`,
+			      `${__dirname}/on.regular.txt`, '10000'])
+	if (r.status !== 0) throw new Error(`exit status is ${r.status}`)
+	assert.equal(r.stdout.toString().trim(), "0")
+    })
+})
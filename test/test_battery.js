@@ -7,9 +7,10 @@ let cp = require('child_process')
 
 let out = '_build.x86_64'
 
-let t = function(name) {
+let t = function(name, args = []) {
+    let file = /^sysfs\./.test(name) ? name : `${name}.txt`
     let r = cp.spawnSync(`${__dirname}/../${out}/test/battery`,
-			 [`${__dirname}/${name}.txt`])
+			 [`${__dirname}/${file}`, ...args])
 //    console.log(r)
     if (r.status !== 0) throw new Error(`${name} exit status is ${r.status}`)
     return r.stdout.toString().trim()
@@ -34,4 +35,10 @@ suite('Battery', function() {
 	assert.equal(t('off.123'), "0 100 0 0:0")
 //	assert.equal(t('off.'), "")
     })
+
+    test('all the packs', function() {
+	assert.equal(t('sysfs.dual'), "0 93 24748 6:52")
+	assert.equal(t('sysfs.dual', ['0']), "0 89 9156 2:32")
+	assert.equal(t('sysfs.dual', ['1']), "0 96 0 0:0")
+    })
 })
@@ -0,0 +1,21 @@
+#!/usr/bin/env -S mocha --ui=tdd
+
+'use strict';
+
+let assert = require('assert')
+let cp = require('child_process')
+
+let out = '_build.x86_64'
+
+let has_xvfb = function() {
+    return cp.spawnSync('sh', ['-c', 'command -v xvfb-run']).status === 0
+}
+
+suite('Dockapp', function() {
+    test('no round trips in 100 ticks', function() {
+	if (!has_xvfb()) this.skip()
+	let r = cp.spawnSync('xvfb-run', ['-a', `${__dirname}/../${out}/test/dockapp`, '100'])
+	if (r.status !== 0) throw new Error(`exit status is ${r.status}`)
+	assert.equal(r.stdout.toString().trim(), "0")
+    })
+})
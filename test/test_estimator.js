@@ -0,0 +1,43 @@
+#!/usr/bin/env -S mocha --ui=tdd
+
+'use strict';
+
+let assert = require('assert')
+let cp = require('child_process')
+
+let out = '_build.x86_64'
+
+// "charging raw smooth"
+let t = function(name, samples) {
+    let args = [`${__dirname}/${name}.txt`]
+    if (samples) args.push(samples)
+    let r = cp.spawnSync(`${__dirname}/../${out}/test/estimator`, args)
+    if (r.status !== 0) throw new Error(`${name} exit status is ${r.status}`)
+    return r.stdout.toString().trim()
+}
+
+suite('Estimator', function() {
+    test('discharging', function() {
+	assert.equal(t('on.regular'), "0 2955 8866")
+	assert.equal(t('on.73'), "0 1277 3831")
+	assert.equal(t('on.negative-power'), "0 6131 18394")
+	assert.equal(t('on.min.100'), "0 0 0")
+    })
+
+    test('charging', function() {
+	assert.equal(t('off.regular'), "1 1215 3646")
+	assert.equal(t('off.charging.mAh'), "1 70 211")
+	assert.equal(t('off.charging.0-rate'), "1 0 0")
+	assert.equal(t('off.123'), "0 0 0")
+    })
+
+    test('a short window uses the average power', function() {
+	assert.equal(t('on.regular', 5), "0 9116 8349")
+	assert.equal(t('off.regular', 5), "1 3896 3568")
+    })
+
+    test('a window that has slid a few times', function() {
+	assert.equal(t('on.regular', 200), "0 17916 7166")
+	assert.equal(t('off.regular', 200), "1 4865 1946")
+    })
+})
@@ -0,0 +1,39 @@
+#!/usr/bin/env -S mocha --ui=tdd
+
+'use strict';
+
+let assert = require('assert')
+let cp = require('child_process')
+let fs = require('fs')
+let os = require('os')
+
+let out = '_build.x86_64'
+let file = `${os.tmpdir()}/wmvolt-test-${process.pid}/state/history.bin`
+
+let t = function(n) {
+    let r = cp.spawnSync(`${__dirname}/../${out}/test/history`, [file, n])
+    if (r.status !== 0)
+	throw new Error(`exit status is ${r.status}: ${r.stderr}`)
+    return r.stdout.toString().trim()
+}
+
+suite('History', function() {
+    suiteTeardown(function() {
+	fs.rmSync(`${os.tmpdir()}/wmvolt-test-${process.pid}`,
+		  { recursive: true, force: true })
+    })
+
+    test('append & survive a restart', function() {
+	assert.equal(t(10), "10 7/2/1000 8/0/1000 9/2/1000 -")
+	assert.equal(t(2), "12 9/2/1000 0/0/1000 1/2/1000 -")
+    })
+
+    test('wrap around', function() {
+	assert.equal(t(8640), "8652 52/2/1000 53/0/1000 54/2/1000 -")
+    })
+
+    test('a foreign file is started anew', function() {
+	fs.writeFileSync(file, 'junk')
+	assert.equal(t(1), "1 0/0/1000 -")
+    })
+})
@@ -0,0 +1,39 @@
+#!/usr/bin/env -S mocha --ui=tdd
+
+'use strict';
+
+let assert = require('assert')
+let cp = require('child_process')
+let fs = require('fs')
+let os = require('os')
+let path = require('path')
+
+let out = '_build.x86_64'
+let wmvolt = `${__dirname}/../${out}/wmvolt`
+
+// draw a fixture w/o X & compare it w/ the frame from `make golden`
+let render = function(name) {
+    let file = path.join(os.tmpdir(), `wmvolt-${process.pid}-${name}.ppm`)
+    let ac = /^on\./.test(name) ? '0' : '1'
+    let r = cp.spawnSync(wmvolt, ['-E', 'raw', '--debug-ac', ac,
+				  '--debug-uevent', `${__dirname}/${name}.txt`,
+				  '--render-to', file])
+    if (r.status !== 0) throw new Error(`${name} exit status is ${r.status}`)
+    let image = fs.readFileSync(file)
+    fs.unlinkSync(file)
+    return image
+}
+
+suite('Render', function() {
+    suiteSetup(function() {
+	if (!fs.existsSync(wmvolt)) this.skip()
+    })
+
+    fs.readdirSync(__dirname).filter( v => /\.txt$/.test(v)).forEach( v => {
+	let name = v.replace(/\.txt$/, '')
+	test(name, function() {
+	    let golden = fs.readFileSync(`${__dirname}/golden/${name}.ppm`)
+	    assert(render(name).equals(golden), `${name} differs`)
+	})
+    })
+})
@@ -0,0 +1,19 @@
+#!/usr/bin/env -S mocha --ui=tdd
+
+'use strict';
+
+let assert = require('assert')
+let cp = require('child_process')
+let os = require('os')
+
+let out = '_build.x86_64'
+
+suite('Server', function() {
+    test('get, subscribe & drop the slow subscribers', function() {
+	let r = cp.spawnSync(`${__dirname}/../${out}/test/server`,
+			     [`${os.tmpdir()}/wmvolt-test-${process.pid}.sock`])
+	if (r.status !== 0)
+	    throw new Error(`exit status is ${r.status}: ${r.stderr}`)
+	assert.equal(r.stdout.toString().trim(), "ok")
+    })
+})
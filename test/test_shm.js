@@ -0,0 +1,67 @@
+#!/usr/bin/env -S mocha --ui=tdd
+
+'use strict';
+
+let assert = require('assert')
+let cp = require('child_process')
+let fs = require('fs')
+
+let out = '_build.x86_64'
+let name = `/wmvolt-test-${process.pid}`
+
+suite('Shm', function() {
+    suiteTeardown(function() {
+	try { fs.unlinkSync(`/dev/shm${name}`) } catch (e) { /* none */ }
+    })
+
+    test('no torn snapshots', function() {
+	let r = cp.spawnSync(`${__dirname}/../${out}/test/shm`,
+			     [name, '200000'])
+	if (r.status !== 0) throw new Error(`exit status is ${r.status}`)
+	assert.equal(r.stdout.toString().trim(), "0")
+    })
+
+    test('wmvolt-read', function() {
+	let r = cp.spawnSync(`${__dirname}/../${out}/wmvolt-read`, [name])
+	if (r.status !== 0) throw new Error(`exit status is ${r.status}`)
+	let kv = Object.fromEntries(r.stdout.toString().trim().split("\n")
+				    .map( v => v.split('=')))
+	assert.equal(kv.capacity, '200000')
+	assert.equal(kv.power, '200000')
+	assert.equal(kv.ac, '0')
+	assert.equal(kv.samples, '200000')
+    })
+
+    test('not a segment', function() {
+	let r = cp.spawnSync(`${__dirname}/../${out}/wmvolt-read`,
+			     ['/wmvolt-no-such-segment'])
+	assert.equal(r.status, 1)
+    })
+
+    test('refuse a segment others can write into', function() {
+	let evil = `${name}-evil`
+	fs.writeFileSync(`/dev/shm${evil}`, '')
+	fs.chmodSync(`/dev/shm${evil}`, 0o666)
+	let r = cp.spawnSync(`${__dirname}/../${out}/test/shm`, [evil, '0'])
+	fs.unlinkSync(`/dev/shm${evil}`)
+	assert.equal(r.status, 1)
+	assert.match(r.stderr.toString(), /Permission denied/)
+    })
+
+    test('1 writer at a time', function(done) {
+	let holder = cp.spawn(`${__dirname}/../${out}/test/shm`, [name, '0'])
+	holder.stdout.once('data', () => {
+	    let r = cp.spawnSync(`${__dirname}/../${out}/test/shm`,
+				 [name, '0'], { input: '' })
+	    holder.stdin.end()
+	    assert.equal(r.status, 1)
+	    assert.match(r.stderr.toString(), /Device or resource busy/)
+	})
+	holder.on('exit', status => {
+	    // the lock is gone w/ the holder
+	    let r = cp.spawnSync(`${__dirname}/../${out}/test/shm`,
+				 [name, '0'], { input: '' })
+	    done(status || r.status ? new Error('exit status') : undefined)
+	})
+    })
+})
@@ -0,0 +1,65 @@
+#!/usr/bin/env -S mocha --ui=tdd
+
+'use strict';
+
+let assert = require('assert')
+let cp = require('child_process')
+let fs = require('fs')
+let os = require('os')
+
+let out = '_build.x86_64'
+let wmvolt = `${__dirname}/../${out}/wmvolt`
+
+// run for a while w/o X & stop it like a service manager would
+let stream = function(format) {
+    let r = cp.spawnSync(wmvolt, ['-E', 'raw', '--debug-ac', '0',
+				  `--stream=${format}`, '--debug-uevent',
+				  `${__dirname}/on.regular.txt`],
+			 { timeout: 1500 })
+    if (r.status !== 0) throw new Error(`exit status is ${r.status}`)
+    return r.stdout.toString().trim().split("\n")
+}
+
+// a regular file gets the records in batches
+let stream_file = function(signal) {
+    let file = `${os.tmpdir()}/wmvolt-test-${process.pid}.jsonl`
+    fs.rmSync(file, { force: true })
+    let r = cp.spawnSync(wmvolt, ['-E', 'raw', '--debug-ac', '0',
+				  '--stream', '--stream-file', file,
+				  '--debug-uevent', `${__dirname}/on.regular.txt`],
+			 { timeout: 1500, killSignal: signal })
+    if (r.status !== 0) throw new Error(`exit status is ${r.status}`)
+    let lines = fs.readFileSync(file).toString().trim().split("\n")
+    fs.rmSync(file)
+    return lines
+}
+
+suite('Stream', function() {
+    suiteSetup(function() {
+	if (!fs.existsSync(wmvolt)) this.skip()
+    })
+
+    test('json', function() {
+	let lines = stream('json')
+	assert.equal(lines.length, 1) // the same fixture, no changes
+	let r = JSON.parse(lines[0])
+	delete r.time
+	assert.deepEqual(r, { id: -1, ac: false, charging: false,
+			      capacity: 89, seconds_remaining: 9156,
+			      energy_now: 28006000, energy_full: 31350000,
+			      power: 11011000 })
+    })
+
+    test('csv', function() {
+	let lines = stream('csv')
+	assert.equal(lines[0], 'time,id,ac,charging,capacity,seconds_remaining,energy_now,energy_full,power')
+	assert.equal(lines[1].replace(/^[^,]+,/, ''),
+		     '-1,0,0,89,9156,28006000,31350000,11011000')
+    })
+
+    test('file, flushed on SIGINT', function() {
+	let lines = stream_file('SIGINT')
+	assert.equal(lines.length, 1)
+	assert.equal(JSON.parse(lines[0]).capacity, 89)
+    })
+})
@@ -0,0 +1,49 @@
+// print the battery state that `wmvolt --publish-shm` keeps in shared
+// memory, as KEY=VAL lines for a shell's eval; never touches sysfs
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <err.h>
+#include <errno.h>
+#include "../shm.h"
+
+#define RETRIES 10		// while a writer is preempted mid-update
+
+int main(int argc, char **argv) {
+  if (argc > 2 || (argc == 2 && argv[1][0] != '/')) {
+    fprintf(stderr, "Usage: wmvolt-read [/segment-name]\n");
+    exit(2);
+  }
+  const char *name = argc == 2 ? argv[1] : shm_default_name();
+
+  const ShmSegment *seg = shm_attach(name);
+  if (!seg) {
+    if (errno == EPROTO) errx(1, "%s: not a wmvolt segment v%d", name,
+			      SHM_VERSION);
+    err(1, "%s", name);
+  }
+
+  ShmSnapshot s;
+  int i;
+  for (i = 0; i < RETRIES && !shm_read(seg, &s); i++)
+    nanosleep(&(struct timespec){ 0, 1000000 }, NULL);
+  if (i == RETRIES) errx(1, "%s: no consistent snapshot", name);
+
+  char ts[21];
+  time_t sec = s.realtime_ns / 1000000000;
+  strftime(ts, sizeof(ts), "%FT%TZ", gmtime(&sec));
+
+  printf("id=%d\n", s.id);
+  printf("ac=%d\n", s.is_ac_power);
+  printf("charging=%d\n", s.is_charging);
+  printf("capacity=%d\n", s.capacity);
+  printf("seconds_remaining=%d\n", s.seconds_remaining);
+  printf("energy_now=%lld\n", (long long)s.energy_now);
+  printf("energy_full=%lld\n", (long long)s.energy_full);
+  printf("power=%lld\n", (long long)s.power);
+  printf("time=%s\n", ts);
+  printf("monotonic_ns=%lld\n", (long long)s.monotonic_ns);
+  printf("samples=%llu\n", (unsigned long long)s.samples);
+  return 0;
+}
@@ -0,0 +1,177 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include "uring.h"
+
+#if defined(NO_URING) || !defined(__NR_io_uring_setup)
+
+Uring *uring_new(unsigned entries) { return NULL; }
+void uring_free(Uring *ring) {}
+bool uring_register(Uring *ring, const struct iovec *iov, unsigned n,
+		    const int *fds, unsigned nfds) { return false; }
+bool uring_read(Uring *ring, UringRead *reads, unsigned n) { return false; }
+
+#else
+
+#include <stdatomic.h>
+#include <linux/io_uring.h>
+
+struct Uring {
+  int fd;
+  unsigned entries;
+  void *sq_ring, *cq_ring;
+  size_t sq_ring_size, cq_ring_size;
+  struct io_uring_sqe *sqes;
+  size_t sqes_size;
+  unsigned *sq_tail, *sq_mask, *sq_array;
+  unsigned *cq_head, *cq_tail, *cq_mask;
+  struct io_uring_cqe *cqes;
+};
+
+static
+int sys_setup(unsigned entries, struct io_uring_params *p) {
+  return syscall(__NR_io_uring_setup, entries, p);
+}
+
+static
+int sys_enter(int fd, unsigned submit, unsigned wait, unsigned flags) {
+  return syscall(__NR_io_uring_enter, fd, submit, wait, flags, NULL, 0);
+}
+
+static
+int sys_register(int fd, unsigned op, const void *arg, unsigned n) {
+  return syscall(__NR_io_uring_register, fd, op, arg, n);
+}
+
+Uring *uring_new(unsigned entries) {
+  Uring *ring = calloc(1, sizeof(Uring));
+  if (!ring) return NULL;
+
+  struct io_uring_params p;
+  memset(&p, 0, sizeof(p));
+  ring->fd = sys_setup(entries, &p);	// rounds entries up to a power of 2
+  if (ring->fd == -1) {
+    free(ring);
+    return NULL;
+  }
+  ring->entries = p.sq_entries;
+
+  ring->sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+  ring->cq_ring_size = p.cq_off.cqes
+    + p.cq_entries * sizeof(struct io_uring_cqe);
+  if (p.features & IORING_FEAT_SINGLE_MMAP) {
+    if (ring->cq_ring_size > ring->sq_ring_size)
+      ring->sq_ring_size = ring->cq_ring_size;
+    ring->cq_ring_size = ring->sq_ring_size;
+  }
+
+  ring->sq_ring = mmap(NULL, ring->sq_ring_size, PROT_READ | PROT_WRITE,
+		       MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+  if (ring->sq_ring == MAP_FAILED) goto fail;
+  ring->cq_ring = ring->sq_ring;
+  if (!(p.features & IORING_FEAT_SINGLE_MMAP)) {
+    ring->cq_ring = mmap(NULL, ring->cq_ring_size, PROT_READ | PROT_WRITE,
+			 MAP_SHARED | MAP_POPULATE, ring->fd,
+			 IORING_OFF_CQ_RING);
+    if (ring->cq_ring == MAP_FAILED) {
+      ring->cq_ring = ring->sq_ring;
+      goto fail;
+    }
+  }
+  ring->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+  ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE,
+		    MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+  if (ring->sqes == MAP_FAILED) {
+    ring->sqes = NULL;
+    goto fail;
+  }
+
+  char *sq = ring->sq_ring, *cq = ring->cq_ring;
+  ring->sq_tail = (unsigned*)(sq + p.sq_off.tail);
+  ring->sq_mask = (unsigned*)(sq + p.sq_off.ring_mask);
+  ring->sq_array = (unsigned*)(sq + p.sq_off.array);
+  ring->cq_head = (unsigned*)(cq + p.cq_off.head);
+  ring->cq_tail = (unsigned*)(cq + p.cq_off.tail);
+  ring->cq_mask = (unsigned*)(cq + p.cq_off.ring_mask);
+  ring->cqes = (struct io_uring_cqe*)(cq + p.cq_off.cqes);
+
+  // the slots never move: sqe #i is always at the index #i
+  for (unsigned i = 0; i < p.sq_entries; ++i) ring->sq_array[i] = i;
+  return ring;
+
+ fail:
+  if (ring->sq_ring == MAP_FAILED) ring->sq_ring = ring->cq_ring = NULL;
+  uring_free(ring);
+  return NULL;
+}
+
+void uring_free(Uring *ring) {
+  if (!ring) return;
+  if (ring->sqes) munmap(ring->sqes, ring->sqes_size);
+  if (ring->cq_ring && ring->cq_ring != ring->sq_ring)
+    munmap(ring->cq_ring, ring->cq_ring_size);
+  if (ring->sq_ring) munmap(ring->sq_ring, ring->sq_ring_size);
+  close(ring->fd);		// unregisters everything
+  free(ring);
+}
+
+bool uring_register(Uring *ring, const struct iovec *iov, unsigned n,
+		    const int *fds, unsigned nfds) {
+  return sys_register(ring->fd, IORING_REGISTER_BUFFERS, iov, n) == 0
+    && sys_register(ring->fd, IORING_REGISTER_FILES, fds, nfds) == 0;
+}
+
+bool uring_read(Uring *ring, UringRead *reads, unsigned n) {
+  // a batch larger than the ring goes in several submissions
+  for (unsigned start = 0; start < n; start += ring->entries) {
+    unsigned count = n - start < ring->entries ? n - start : ring->entries;
+
+    unsigned tail = *ring->sq_tail;
+    for (unsigned i = 0; i < count; ++i) {
+      UringRead *r = &reads[start + i];
+      struct io_uring_sqe *sqe = &ring->sqes[(tail + i) & *ring->sq_mask];
+      memset(sqe, 0, sizeof(*sqe));
+      sqe->opcode = IORING_OP_READ_FIXED;
+      sqe->flags = IOSQE_FIXED_FILE;
+      sqe->fd = r->file;
+      sqe->off = 0;
+      sqe->addr = (unsigned long)r->buf;
+      sqe->len = r->size;
+      sqe->buf_index = r->buf_index;
+      sqe->user_data = start + i;
+      r->len = -EINPROGRESS;
+    }
+    atomic_store_explicit((_Atomic unsigned*)ring->sq_tail, tail + count,
+			  memory_order_release);
+
+    // a short submission leaves the ring in an unknown state: the
+    // caller drops it & falls back to pread(2)
+    if (sys_enter(ring->fd, count, count, IORING_ENTER_GETEVENTS)
+	!= (int)count) return false;
+
+    // the next batch reuses the buffers, so every read of this one
+    // must be reaped first, however many times the wait is cut short
+    for (unsigned reaped = 0; reaped < count; ) {
+      unsigned head = *ring->cq_head;
+      unsigned ctail = atomic_load_explicit((_Atomic unsigned*)ring->cq_tail,
+					    memory_order_acquire);
+      for (; head != ctail; ++head, ++reaped) {
+	struct io_uring_cqe *cqe = &ring->cqes[head & *ring->cq_mask];
+	if (cqe->user_data < n) reads[cqe->user_data].len = cqe->res;
+      }
+      atomic_store_explicit((_Atomic unsigned*)ring->cq_head, head,
+			    memory_order_release);
+
+      if (reaped < count
+	  && sys_enter(ring->fd, 0, count - reaped, IORING_ENTER_GETEVENTS)
+	  == -1 && errno != EINTR) return false;
+    }
+  }
+  return true;
+}
+
+#endif
@@ -0,0 +1,32 @@
+#ifndef URING_H
+#define URING_H
+
+#include <stdbool.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+// a minimal io_uring (w/o liburing) that reads a batch of
+// pre-registered files into pre-registered buffers
+typedef struct Uring Uring;
+
+typedef struct UringRead {
+  unsigned file;		// an index in the registered fds
+  unsigned buf_index;		// an index in the registered iovecs
+  char *buf;			// must be inside iovecs[buf_index]
+  unsigned size;
+  ssize_t len;			// the result, -errno on error
+} UringRead;
+
+// NULL if the kernel has no io_uring, it's disabled or wmvolt was
+// built w/ NO_URING
+Uring *uring_new(unsigned);
+void uring_free(Uring*);
+// return false on error
+bool uring_register(Uring*, const struct iovec*, unsigned,
+		    const int*, unsigned);
+// read every file from offset 0 & wait for all of them; return false
+// if the batch wasn't submitted or the wait failed (the results are
+// unknown then & the ring shouldn't be used again)
+bool uring_read(Uring*, UringRead*, unsigned);
+
+#endif